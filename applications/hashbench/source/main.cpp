@@ -0,0 +1,159 @@
+#include "hashtable.hpp"
+#include "openaddressinghashtable.hpp"
+#include "filteredhashtable.hpp"
+
+#include <chrono>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+// Per-insert latency distribution while loading a table from empty, with
+// one-shot and incremental rehashing. The one-shot mode pays for each
+// doubling in a single insert, which shows up at the far tail.
+//
+// Then lookup throughput on the loaded tables, one key at a time against
+// find_batch, which overlaps the cache misses across a batch, and the cost
+// of lookups that miss with and without a filter in front of the table.
+
+typedef std::chrono::steady_clock clock_t_;
+
+typedef HashTable<int, int, DefaultHash<int>, PowerOfTwoReduction, InlineRows<int, int, 3>> InlineHashTable;
+
+template<typename Table>
+std::vector<double> insertLatencies( Table& table, size_t count )
+{
+    std::vector<double> latencies;
+    latencies.reserve( count );
+    
+    for ( size_t i = 0; i < count; ++i )
+    {
+        auto kv = std::make_pair( static_cast<int>( i * 2654435761U ), static_cast<int>( i ) );
+        auto start = clock_t_::now();
+        table.insert( kv );
+        auto end = clock_t_::now();
+        latencies.push_back( std::chrono::duration<double, std::nano>( end - start ).count() );
+    }
+    return latencies;
+}
+
+template<typename Table, typename Out>
+void lookupThroughput( const std::string& name, Table& table, size_t count )
+{
+    std::vector<int> keys;
+    keys.reserve( count );
+    for ( size_t i = 0; i < count; ++i )
+    {
+        keys.push_back( static_cast<int>( ((i * 7919) % count) * 2654435761U ) );
+    }
+    
+    size_t hits = 0;
+    auto start = clock_t_::now();
+    for ( int k : keys ) hits += table.findPtr( k ) != NULL;
+    auto mid = clock_t_::now();
+    
+    Out out;
+    table.find_batch( keys, out );
+    for ( auto v : out ) hits += v != NULL;
+    auto end = clock_t_::now();
+    
+    auto perKey = [count]( clock_t_::duration d ) { return std::chrono::duration<double, std::nano>( d ).count() / count; };
+    std::cout << std::left << std::setw( 36 ) << name << std::right << std::fixed << std::setprecision( 1 )
+        << std::setw( 12 ) << perKey( mid - start )
+        << std::setw( 12 ) << perKey( end - mid )
+        << std::setw( 12 ) << hits << std::endl;
+}
+
+// Lookups for keys that are all absent from table
+template<typename Table>
+void missThroughput( const std::string& name, Table& table, size_t count )
+{
+    size_t hits = 0;
+    auto start = clock_t_::now();
+    for ( size_t i = 0; i < count; ++i ) hits += table.find( static_cast<int>( i * 2654435761U + 1 ) );
+    auto end = clock_t_::now();
+    
+    std::cout << std::left << std::setw( 36 ) << name << std::right << std::fixed << std::setprecision( 1 )
+        << std::setw( 12 ) << std::chrono::duration<double, std::nano>( end - start ).count() / count
+        << std::setw( 12 ) << hits << std::endl;
+}
+
+void report( const std::string& name, std::vector<double> latencies )
+{
+    std::sort( latencies.begin(), latencies.end() );
+    auto pct = [&latencies]( double p ) -> double
+    {
+        size_t i = std::min( latencies.size() - 1, static_cast<size_t>( p * latencies.size() ) );
+        return latencies[i];
+    };
+    
+    double total = 0.0;
+    for ( double l : latencies ) total += l;
+    
+    std::cout << std::left << std::setw( 36 ) << name << std::right << std::fixed << std::setprecision( 0 )
+        << std::setw( 10 ) << total / latencies.size()
+        << std::setw( 10 ) << pct( 0.5 )
+        << std::setw( 10 ) << pct( 0.99 )
+        << std::setw( 10 ) << pct( 0.999 )
+        << std::setw( 12 ) << pct( 0.9999 )
+        << std::setw( 14 ) << latencies.back() << std::endl;
+}
+
+int main( int argc, char** argv )
+{
+    size_t count = argc > 1 ? std::strtoul( argv[1], NULL, 10 ) : 4000000;
+    size_t step = argc > 2 ? std::strtoul( argv[2], NULL, 10 ) : 8;
+    
+    std::cout << "Insert latency (ns) loading " << count << " keys, incremental step " << step << std::endl;
+    std::cout << std::left << std::setw( 36 ) << "table" << std::right
+        << std::setw( 10 ) << "mean" << std::setw( 10 ) << "p50" << std::setw( 10 ) << "p99"
+        << std::setw( 10 ) << "p99.9" << std::setw( 12 ) << "p99.99" << std::setw( 14 ) << "max" << std::endl;
+    
+    OpenAddressingHashTable<int, int> loadedOpen( 16 );
+    report( "OpenAddressingHashTable one-shot", insertLatencies( loadedOpen, count ) );
+    {
+        OpenAddressingHashTable<int, int> h( 16 );
+        h.incremental_rehash( step );
+        report( "OpenAddressingHashTable incremental", insertLatencies( h, count ) );
+    }
+    HashTable<int, int> loadedChained( 16, 0 );
+    report( "HashTable one-shot", insertLatencies( loadedChained, count ) );
+    {
+        HashTable<int, int> h( 16, 0 );
+        h.incremental_rehash( step );
+        report( "HashTable incremental", insertLatencies( h, count ) );
+    }
+    InlineHashTable loadedInline( 16, 0 );
+    report( "HashTable inline one-shot", insertLatencies( loadedInline, count ) );
+    
+    std::cout << std::endl << "Lookup (ns/key) over " << count << " keys" << std::endl;
+    std::cout << std::left << std::setw( 36 ) << "table" << std::right
+        << std::setw( 12 ) << "find" << std::setw( 12 ) << "find_batch" << std::setw( 12 ) << "hits" << std::endl;
+    lookupThroughput<OpenAddressingHashTable<int, int>, std::vector<const int*>>( "OpenAddressingHashTable", loadedOpen, count );
+    lookupThroughput<HashTable<int, int>, std::vector<int*>>( "HashTable", loadedChained, count );
+    lookupThroughput<InlineHashTable, std::vector<int*>>( "HashTable inline", loadedInline, count );
+    
+    FilteredHashTable<HashTable<int, int>> bloomChained( 16, 0 );
+    FilteredHashTable<OpenAddressingHashTable<int, int>, CuckooFilter> cuckooOpen( 16 );
+    insertLatencies( bloomChained, count );
+    insertLatencies( cuckooOpen, count );
+    
+    std::cout << std::endl << "Missing key lookup (ns/key) over " << count << " keys" << std::endl;
+    std::cout << std::left << std::setw( 36 ) << "table" << std::right << std::setw( 12 ) << "find" << std::setw( 12 ) << "hits" << std::endl;
+    missThroughput( "OpenAddressingHashTable", loadedOpen, count );
+    missThroughput( "OpenAddressingHashTable + cuckoo", cuckooOpen, count );
+    missThroughput( "HashTable", loadedChained, count );
+    missThroughput( "HashTable + Bloom", bloomChained, count );
+    
+#ifdef HASH_TABLE_STATS
+    auto openStats = loadedOpen.stats();
+    auto chainedStats = loadedChained.stats();
+    std::cout << std::endl << "OpenAddressingHashTable: load " << std::setprecision( 3 ) << openStats.loadFactor
+        << ", longest probe " << openStats.probeLengths.size() << ", longest cluster " << openStats.longestCluster
+        << ", rehashes " << openStats.rehashes << std::endl;
+    std::cout << "HashTable: load " << chainedStats.loadFactor << ", longest chain " << chainedStats.longestChain
+        << ", rehashes " << chainedStats.rehashes << std::endl;
+#endif
+}
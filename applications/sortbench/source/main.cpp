@@ -0,0 +1,417 @@
+#include "mergesort.hpp"
+#include "quicksort.hpp"
+#include "adaptivemergesort.hpp"
+#include "radixsort.hpp"
+#include "samplesort.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <random>
+#include <limits>
+#include <sstream>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+// Sort times for each of our sorts and the standard library's, over element
+// types from ints to strings and 32 byte records, sizes from a thousand
+// elements up, and inputs chosen both to look like real data (Zipfian keys,
+// nearly sorted logs, sorted batches) and to defeat quicksort pivot
+// selection (organ pipes, heavy duplication, and McIlroy's "killer
+// adversary", which builds an input on the fly that makes a given quicksort
+// pick the worst pivot it can at every step).
+//
+// As well as time per element, each sort is run once more on elements that
+// count their own moves and copies, for the bytes each sort writes per
+// element. The count is of element moves only, so it leaves out the
+// sorting network path for plain numbers, which works in registers.
+//
+//   sortbench [--max N] [--sizes N,N,...] [--types int,double,string,record] [--no-moves] [--csv]
+//
+// Sizes run from 1000 up by factors of ten to --max (default 1000000), or
+// are given with --sizes. --csv prints one line per sort and input, for
+// regression tracking.
+
+typedef std::chrono::steady_clock clock_t_;
+
+// Killer inputs take a sort through std::function, so they are slow to
+// build for large sizes
+const size_t killerMaxSize = 1 << 22;
+
+// Above this many elements each sort is timed once rather than best of three
+const size_t singleRunSize = 10000000;
+
+// 32 bytes, sorted on one field, like a row of a table
+struct Record
+{
+    uint64_t    key;
+    uint64_t    payload[3];
+
+    bool operator<( const Record& other ) const { return key < other.key; }
+};
+
+// Element writes since the counting run started
+std::atomic<uint64_t> g_elementWrites( 0 );
+
+// An element that counts every time it is moved or copied into
+template<typename T>
+struct Counted
+{
+    Counted() : value()
+    {
+    }
+
+    explicit Counted( const T& v ) : value( v )
+    {
+    }
+
+    Counted( const Counted& other ) : value( other.value ) { count(); }
+    Counted( Counted&& other ) : value( std::move( other.value ) ) { count(); }
+    Counted& operator=( const Counted& other ) { value = other.value; count(); return *this; }
+    Counted& operator=( Counted&& other ) { value = std::move( other.value ); count(); return *this; }
+
+    bool operator<( const Counted& other ) const { return value < other.value; }
+
+    static void count() { g_elementWrites.fetch_add( 1, std::memory_order_relaxed ); }
+
+    T   value;
+};
+
+// Building each element type from a generated 32 bit key. Strings are
+// zero-padded so that they sort as the keys do.
+void fromKey( uint64_t key, int& out ) { out = static_cast<int>( key & 0x7fffffff ); }
+void fromKey( uint64_t key, double& out ) { out = static_cast<double>( key ) / 7.0; }
+
+void fromKey( uint64_t key, std::string& out )
+{
+    char buf[24];
+    std::snprintf( buf, sizeof(buf), "%012llu", static_cast<unsigned long long>( key ) );
+    out = buf;
+}
+
+void fromKey( uint64_t key, Record& out )
+{
+    out.key = key;
+    for ( uint64_t& p : out.payload ) p = key;
+}
+
+// The key radixSort sorts each element type by. Strings have none.
+struct RadixKey
+{
+    int operator()( int x ) const { return x; }
+    double operator()( double x ) const { return x; }
+    uint64_t operator()( const Record& r ) const { return r.key; }
+
+    int operator()( const Counted<int>& c ) const { return c.value; }
+    double operator()( const Counted<double>& c ) const { return c.value; }
+    uint64_t operator()( const Counted<Record>& c ) const { return c.value.key; }
+};
+
+template<typename T>
+struct HasRadixKey : std::integral_constant<bool, !std::is_same<T, std::string>::value>
+{
+};
+
+template<typename T>
+struct HasRadixKey<Counted<T>> : HasRadixKey<T>
+{
+};
+
+// McIlroy, "A Killer Adversary for Quicksort". Sorts indices with a
+// comparator that leaves every value undecided ("gas") until it has to
+// commit, and then commits so that the pivot candidate comes out smallest.
+// The values it commits to are an input on which a deterministic sort makes
+// the same comparisons again.
+std::vector<int> killerInput( size_t n, const std::function<void(std::vector<int>&, std::function<bool(int, int)>)>& sort )
+{
+    const int gas = static_cast<int>( n );
+    std::vector<int> values( n, gas );
+    int solid = 0;
+    int candidate = 0;
+
+    auto freeze = [&]( int x ) { values[x] = solid++; };
+    std::vector<int> indices;
+    for ( size_t i = 0; i < n; ++i ) indices.push_back( static_cast<int>( i ) );
+
+    sort( indices, [&]( int x, int y )
+    {
+        if ( values[x] == gas && values[y] == gas ) freeze( x == candidate ? x : y );
+        if ( values[x] == gas ) candidate = x;
+        else if ( values[y] == gas ) candidate = y;
+        return values[x] < values[y];
+    } );
+
+    for ( int& v : values ) if ( v == gas ) v = solid++;
+    return values;
+}
+
+std::vector<std::string> distributions( size_t n )
+{
+    std::vector<std::string> names = {
+        "uniform", "sorted", "reversed", "organ pipe", "sawtooth", "few unique", "all equal",
+        "zipfian", "nearly sorted", "sorted batches" };
+
+    if ( n <= killerMaxSize )
+    {
+        names.push_back( "killer (quickSort)" );
+        names.push_back( "killer (std::sort)" );
+    }
+    return names;
+}
+
+// The keys of one input
+std::vector<uint64_t> makeKeys( const std::string& name, size_t n )
+{
+    std::mt19937 gen( 0xdeadbeef );
+    std::uniform_int_distribution<uint32_t> unif( 0, std::numeric_limits<int>::max() );
+
+    std::vector<uint64_t> keys( n );
+    if ( name == "uniform" ) for ( auto& k : keys ) k = unif( gen );
+    else if ( name == "sorted" ) for ( size_t i = 0; i < n; ++i ) keys[i] = i;
+    else if ( name == "reversed" ) for ( size_t i = 0; i < n; ++i ) keys[i] = n - i;
+    else if ( name == "organ pipe" ) for ( size_t i = 0; i < n; ++i ) keys[i] = std::min( i, n - i );
+    else if ( name == "sawtooth" ) for ( size_t i = 0; i < n; ++i ) keys[i] = i % 1000;
+    else if ( name == "few unique" ) for ( auto& k : keys ) k = unif( gen ) % 4;
+    else if ( name == "all equal" ) std::fill( keys.begin(), keys.end(), 42 );
+    else if ( name == "zipfian" )
+    {
+        // The r-th most common of up to a million values turns up in
+        // proportion to 1 / r. Ranks are scattered over the key space so
+        // that the common values aren't also the smallest.
+        size_t distinct = std::min<size_t>( n, 1 << 20 );
+        std::vector<double> weights;
+        for ( size_t r = 1; r <= distinct; ++r ) weights.push_back( 1.0 / r );
+        std::discrete_distribution<uint32_t> zipf( weights.begin(), weights.end() );
+        for ( auto& k : keys ) k = (zipf( gen ) * uint64_t( 2654435761U )) & 0x7fffffff;
+    }
+    else if ( name == "nearly sorted" )
+    {
+        // Sorted, then n / 100 random pairs swapped
+        for ( size_t i = 0; i < n; ++i ) keys[i] = i;
+        std::uniform_int_distribution<size_t> position( 0, n - 1 );
+        for ( size_t s = 0; s < n / 100 + 1; ++s ) std::swap( keys[position( gen )], keys[position( gen )] );
+    }
+    else if ( name == "sorted batches" )
+    {
+        // Eight sorted batches end to end, like merged event logs
+        for ( auto& k : keys ) k = unif( gen );
+        for ( size_t b = 0; b < 8; ++b ) std::sort( keys.begin() + n * b / 8, keys.begin() + n * (b + 1) / 8 );
+    }
+    else
+    {
+        std::vector<int> ranks;
+        if ( name == "killer (quickSort)" )
+        {
+            ranks = killerInput( n, []( std::vector<int>& v, std::function<bool(int, int)> cmp ) { quickSort( v.begin(), v.end(), cmp ); } );
+        }
+        else
+        {
+            ranks = killerInput( n, []( std::vector<int>& v, std::function<bool(int, int)> cmp ) { std::sort( v.begin(), v.end(), cmp ); } );
+        }
+        std::copy( ranks.begin(), ranks.end(), keys.begin() );
+    }
+    return keys;
+}
+
+template<typename E>
+struct Sort
+{
+    std::string                                 name;
+    std::function<void(std::vector<E>&)>        sort;
+};
+
+template<typename E>
+std::function<void(std::vector<E>&)> radixSortFor( std::true_type )
+{
+    return []( std::vector<E>& v ) { radixSort( v, RadixKey() ); };
+}
+
+template<typename E>
+std::function<void(std::vector<E>&)> radixSortFor( std::false_type )
+{
+    return std::function<void(std::vector<E>&)>();
+}
+
+// Every sort, in column order. Those that don't apply to E are empty.
+template<typename E>
+std::vector<Sort<E>> sorts()
+{
+    typedef std::vector<E> V;
+    return {
+        { "quickSort", []( V& v ) { quickSort( v ); } },
+        { "mergeSort", []( V& v ) { mergeSort( v ); } },
+        { "adaptive", []( V& v ) { adaptiveMergeSort( v ); } },
+        { "sampleSort", []( V& v ) { sampleSort( v, ThreadPool::shared() ); } },
+        { "radixSort", radixSortFor<E>( HasRadixKey<E>() ) },
+        { "std::sort", []( V& v ) { std::sort( v.begin(), v.end() ); } },
+        { "std::stable_sort", []( V& v ) { std::stable_sort( v.begin(), v.end() ); } } };
+}
+
+// Best of a few runs, in ns per element
+template<typename E>
+double timeSort( const std::vector<E>& input, const std::function<void(std::vector<E>&)>& sort )
+{
+    size_t reps = input.size() > singleRunSize ? 1 : 3;
+    double best = 0.0;
+    for ( size_t rep = 0; rep < reps; ++rep )
+    {
+        std::vector<E> data = input;
+        auto start = clock_t_::now();
+        sort( data );
+        auto end = clock_t_::now();
+        if ( !std::is_sorted( data.begin(), data.end() ) )
+        {
+            std::cerr << "Output not sorted" << std::endl;
+            std::exit( 1 );
+        }
+
+        double ns = std::chrono::duration<double, std::nano>( end - start ).count() / input.size();
+        if ( rep == 0 || ns < best ) best = ns;
+    }
+    return best;
+}
+
+// Bytes written by element moves and copies, per element
+template<typename T>
+double bytesMoved( const std::vector<T>& input, const std::function<void(std::vector<Counted<T>>&)>& sort )
+{
+    std::vector<Counted<T>> data;
+    data.reserve( input.size() );
+    for ( const T& x : input ) data.emplace_back( x );
+
+    g_elementWrites = 0;
+    sort( data );
+    return double( g_elementWrites.load() ) * sizeof(T) / input.size();
+}
+
+struct Options
+{
+    std::vector<size_t>         sizes;
+    std::vector<std::string>    types;
+    bool                        moves;
+    bool                        csv;
+};
+
+template<typename T>
+void benchmarkType( const std::string& typeName, const Options& options )
+{
+    auto timed = sorts<T>();
+    auto counted = sorts<Counted<T>>();
+
+    for ( size_t n : options.sizes )
+    {
+        for ( const auto& distribution : distributions( n ) )
+        {
+            std::vector<T> input( n );
+            {
+                auto keys = makeKeys( distribution, n );
+                for ( size_t i = 0; i < n; ++i ) fromKey( keys[i], input[i] );
+            }
+
+            if ( !options.csv )
+            {
+                std::cout << std::left << std::setw( 8 ) << typeName << std::setw( 12 ) << n << std::setw( 20 ) << distribution << std::right;
+            }
+
+            for ( size_t s = 0; s < timed.size(); ++s )
+            {
+                if ( !timed[s].sort )
+                {
+                    if ( !options.csv ) std::cout << std::setw( 18 ) << "-";
+                    continue;
+                }
+
+                double ns = timeSort( input, timed[s].sort );
+                double bytes = options.moves ? bytesMoved( input, counted[s].sort ) : 0.0;
+                if ( options.csv )
+                {
+                    std::cout << typeName << "," << distribution << "," << n << "," << timed[s].name << ","
+                        << std::setprecision( 4 ) << ns << ",";
+                    if ( options.moves ) std::cout << bytes;
+                    std::cout << std::endl;
+                }
+                else
+                {
+                    std::ostringstream cell;
+                    cell << std::fixed << std::setprecision( 1 ) << ns;
+                    if ( options.moves ) cell << " /" << std::setw( 5 ) << std::setprecision( 0 ) << bytes;
+                    std::cout << std::setw( 18 ) << cell.str();
+                }
+            }
+            if ( !options.csv ) std::cout << std::endl;
+        }
+    }
+}
+
+std::vector<std::string> split( const std::string& list )
+{
+    std::vector<std::string> parts;
+    std::istringstream in( list );
+    std::string part;
+    while ( std::getline( in, part, ',' ) ) parts.push_back( part );
+    return parts;
+}
+
+int main( int argc, char** argv )
+{
+    Options options;
+    options.types = { "int", "double", "string", "record" };
+    options.moves = true;
+    options.csv = false;
+
+    size_t maxSize = 1000000;
+    for ( int i = 1; i < argc; ++i )
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if ( arg == "--csv" ) options.csv = true;
+        else if ( arg == "--no-moves" ) options.moves = false;
+        else if ( arg == "--max" && hasValue ) maxSize = std::strtoull( argv[++i], NULL, 10 );
+        else if ( arg == "--types" && hasValue ) options.types = split( argv[++i] );
+        else if ( arg == "--sizes" && hasValue )
+        {
+            for ( const auto& size : split( argv[++i] ) ) options.sizes.push_back( std::strtoull( size.c_str(), NULL, 10 ) );
+        }
+        else
+        {
+            std::cerr << "Usage: sortbench [--max N] [--sizes N,N,...] [--types int,double,string,record] [--no-moves] [--csv]" << std::endl;
+            return 1;
+        }
+    }
+    if ( options.sizes.empty() )
+    {
+        for ( size_t n = 1000; n <= maxSize; n *= 10 ) options.sizes.push_back( n );
+    }
+
+    if ( options.csv )
+    {
+        std::cout << "type,distribution,elements,sort,ns_per_element,bytes_moved_per_element" << std::endl;
+    }
+    else
+    {
+        std::cout << "Sort time (ns/element)" << (options.moves ? " / bytes moved per element" : "") << std::endl;
+        std::cout << std::left << std::setw( 8 ) << "type" << std::setw( 12 ) << "elements" << std::setw( 20 ) << "input" << std::right;
+        for ( const auto& s : sorts<int>() ) std::cout << std::setw( 18 ) << s.name;
+        std::cout << std::endl;
+    }
+
+    for ( const auto& type : options.types )
+    {
+        if ( type == "int" ) benchmarkType<int>( type, options );
+        else if ( type == "double" ) benchmarkType<double>( type, options );
+        else if ( type == "string" ) benchmarkType<std::string>( type, options );
+        else if ( type == "record" ) benchmarkType<Record>( type, options );
+        else
+        {
+            std::cerr << "Unknown type " << type << std::endl;
+            return 1;
+        }
+    }
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+
+#include "rwlock.hpp"
+
+// Chained hash map split across a fixed number of independently locked
+// stripes. The low bits of the hash pick the stripe and the remaining bits
+// the bucket within it, so threads working on different stripes never touch
+// the same lock. Lookups take the stripe lock shared; inserts, erases and
+// upserts take it exclusively, and each stripe grows on its own.
+template<typename K, typename V>
+class ConcurrentHashMap
+{
+private:
+    static const size_t cacheLineSize = 64;
+
+    typedef std::vector<std::pair<K, V>> row_t;
+
+    // Padded out so that the hot fields of neighbouring stripes never share
+    // a cache line, whatever the alignment of the array holding them.
+    struct Stripe
+    {
+        Stripe() : m_size(0)
+        {
+        }
+
+        RWLock              m_lock;
+        size_t              m_size;
+        std::vector<row_t>  m_buckets;
+        char                m_pad[cacheLineSize];
+    };
+
+    size_t stripeIndex( size_t hash ) const { return hash % m_numStripes; }
+
+    static row_t& row( Stripe& stripe, size_t hash, size_t numStripes )
+    {
+        return stripe.m_buckets[(hash / numStripes) % stripe.m_buckets.size()];
+    }
+
+    static typename row_t::iterator findInRow( row_t& r, const K& key )
+    {
+        for ( auto it = r.begin(); it != r.end(); ++it )
+        {
+            if ( it->first == key ) return it;
+        }
+        return r.end();
+    }
+
+    // Double the stripe's bucket count once its chains average more than one
+    // element. Called with the stripe lock held exclusively.
+    void growIfRequired( Stripe& stripe )
+    {
+        if ( stripe.m_size + 1 <= stripe.m_buckets.size() ) return;
+
+        std::vector<row_t> old( stripe.m_buckets.size() * 2 );
+        old.swap( stripe.m_buckets );
+        for ( auto& r : old )
+        {
+            for ( auto& kv : r ) row( stripe, m_hashFn( kv.first ), m_numStripes ).push_back( std::move(kv) );
+        }
+    }
+
+    Stripe& stripeFor( size_t hash ) const { return m_stripes[stripeIndex( hash )]; }
+
+public:
+    ConcurrentHashMap( size_t numStripes = 64, size_t bucketsPerStripe = 16 ) :
+        m_numStripes( std::max<size_t>( numStripes, 1 ) ),
+        m_stripes( new Stripe[m_numStripes] )
+    {
+        for ( size_t i = 0; i < m_numStripes; ++i )
+        {
+            m_stripes[i].m_buckets.resize( std::max<size_t>( bucketsPerStripe, 1 ) );
+        }
+    }
+
+    // Returns false, leaving the existing value alone, if the key is already present
+    bool insert( const std::pair<K, V>& kv )
+    {
+        size_t hash = m_hashFn( kv.first );
+        Stripe& stripe = stripeFor( hash );
+        std::lock_guard<RWLock> lock( stripe.m_lock );
+
+        row_t& r = row( stripe, hash, m_numStripes );
+        if ( findInRow( r, kv.first ) != r.end() ) return false;
+
+        growIfRequired( stripe );
+        row( stripe, hash, m_numStripes ).push_back( kv );
+        stripe.m_size++;
+        return true;
+    }
+
+    bool find( const K& key ) const
+    {
+        size_t hash = m_hashFn( key );
+        Stripe& stripe = stripeFor( hash );
+        SharedLockGuard lock( stripe.m_lock );
+
+        row_t& r = row( stripe, hash, m_numStripes );
+        return findInRow( r, key ) != r.end();
+    }
+
+    // Copies the value out, as no reference into the map is safe once the
+    // stripe lock is released.
+    bool find( const K& key, V& value ) const
+    {
+        size_t hash = m_hashFn( key );
+        Stripe& stripe = stripeFor( hash );
+        SharedLockGuard lock( stripe.m_lock );
+
+        row_t& r = row( stripe, hash, m_numStripes );
+        auto it = findInRow( r, key );
+        if ( it == r.end() ) return false;
+
+        value = it->second;
+        return true;
+    }
+
+    bool erase( const K& key )
+    {
+        size_t hash = m_hashFn( key );
+        Stripe& stripe = stripeFor( hash );
+        std::lock_guard<RWLock> lock( stripe.m_lock );
+
+        row_t& r = row( stripe, hash, m_numStripes );
+        auto it = findInRow( r, key );
+        if ( it == r.end() ) return false;
+
+        // Order within a chain doesn't matter, so avoid shuffling the tail down
+        std::swap( *it, r.back() );
+        r.pop_back();
+        stripe.m_size--;
+        return true;
+    }
+
+    // Apply fn to the value for key under the stripe's exclusive lock, first
+    // inserting a default constructed value if the key is absent. Returns
+    // true if the key was inserted.
+    template<typename Fn>
+    bool upsert( const K& key, Fn fn )
+    {
+        size_t hash = m_hashFn( key );
+        Stripe& stripe = stripeFor( hash );
+        std::lock_guard<RWLock> lock( stripe.m_lock );
+
+        row_t& r = row( stripe, hash, m_numStripes );
+        auto it = findInRow( r, key );
+        if ( it != r.end() )
+        {
+            fn( it->second );
+            return false;
+        }
+
+        growIfRequired( stripe );
+        row_t& target = row( stripe, hash, m_numStripes );
+        target.push_back( std::make_pair( key, V() ) );
+        fn( target.back().second );
+        stripe.m_size++;
+        return true;
+    }
+
+    // Not a snapshot: stripes are counted one at a time
+    size_t size() const
+    {
+        size_t total = 0;
+        for ( size_t i = 0; i < m_numStripes; ++i )
+        {
+            SharedLockGuard lock( m_stripes[i].m_lock );
+            total += m_stripes[i].m_size;
+        }
+        return total;
+    }
+
+private:
+    size_t                      m_numStripes;
+    std::unique_ptr<Stripe[]>   m_stripes;
+    std::hash<K>                m_hashFn;
+};
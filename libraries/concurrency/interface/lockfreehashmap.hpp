@@ -0,0 +1,157 @@
+#pragma once
+
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+
+#include "checks.hpp"
+#include "hashing.hpp"
+
+// Open addressing map for integral keys and values in which no operation
+// ever takes a lock. A key is claimed by CASing it into an empty slot and is
+// never removed, so once a thread has seen a key in a slot it stays there and
+// the value beside it can be read and updated with plain atomics.
+//
+// Every value starts as V(), so a slot is usable the moment its key is
+// claimed and no thread ever waits for another. insert claims the key and
+// then CASes its value in over V(). A store or fetch_add that reaches the
+// key in between counts as having come first: the insert then leaves the
+// value alone and returns false, as if it had found the key present. (A
+// store of V() itself can't be told apart from no store, and loses to the
+// insert.) A reader in that window sees the key with a value of V().
+//
+// The capacity is fixed at construction (rounded up to a power of two) and
+// there is no erase: size the table for the expected number of keys with
+// some headroom, as probe lengths grow quickly beyond ~75% full.
+template<typename K, typename V>
+class LockFreeHashMap
+{
+private:
+    static_assert( std::is_integral<K>::value, "LockFreeHashMap keys must be integral" );
+    static_assert( std::is_integral<V>::value, "LockFreeHashMap values must be integral" );
+
+    struct Slot
+    {
+        std::atomic<K>  m_key;
+        std::atomic<V>  m_value;
+    };
+
+    // Identity hashes cluster badly under linear probing, so mix the key
+    static size_t home( K key ) { return static_cast<size_t>( mix64( static_cast<uint64_t>( key ) ) ); }
+
+    // The slot holding key, or NULL if it is absent
+    Slot* findSlot( K key ) const
+    {
+        size_t i = home( key ) & m_mask;
+        for ( size_t probed = 0; probed <= m_mask; ++probed )
+        {
+            K current = m_slots[i].m_key.load( std::memory_order_acquire );
+            if ( current == key ) return &m_slots[i];
+            if ( current == m_emptyKey ) return NULL;
+            i = (i + 1) & m_mask;
+        }
+        return NULL;
+    }
+
+    // The slot holding key, claiming an empty one if it is absent. inserted
+    // reports which of the two happened.
+    Slot& claimSlot( K key, bool& inserted )
+    {
+        throwing_assert( key != m_emptyKey, "The empty key cannot be stored in a LockFreeHashMap" );
+
+        size_t i = home( key ) & m_mask;
+        for ( size_t probed = 0; probed <= m_mask; ++probed )
+        {
+            Slot& slot = m_slots[i];
+            K current = slot.m_key.load( std::memory_order_acquire );
+            if ( current == m_emptyKey )
+            {
+                // On failure current is reloaded with whichever key beat us to it
+                if ( slot.m_key.compare_exchange_strong( current, key, std::memory_order_acq_rel ) )
+                {
+                    m_size.fetch_add( 1, std::memory_order_relaxed );
+                    inserted = true;
+                    return slot;
+                }
+            }
+            if ( current == key )
+            {
+                inserted = false;
+                return slot;
+            }
+            i = (i + 1) & m_mask;
+        }
+
+        throwing_assert( false, "LockFreeHashMap is full" );
+        return m_slots[0];
+    }
+
+public:
+    LockFreeHashMap( size_t capacity, K emptyKey = std::numeric_limits<K>::max() ) :
+        m_mask(0),
+        m_emptyKey(emptyKey),
+        m_size(0)
+    {
+        size_t numSlots = 1;
+        while ( numSlots < capacity ) numSlots *= 2;
+        m_mask = numSlots - 1;
+
+        m_slots.reset( new Slot[numSlots] );
+        for ( size_t i = 0; i < numSlots; ++i )
+        {
+            m_slots[i].m_key.store( m_emptyKey, std::memory_order_relaxed );
+            m_slots[i].m_value.store( V(), std::memory_order_relaxed );
+        }
+    }
+
+    // Returns false, leaving the existing value alone, if the key is already
+    // present or was updated while this insert was claiming it
+    bool insert( K key, V value )
+    {
+        bool inserted = false;
+        Slot& slot = claimSlot( key, inserted );
+        if ( !inserted ) return false;
+
+        V expected = V();
+        return slot.m_value.compare_exchange_strong( expected, value, std::memory_order_acq_rel );
+    }
+
+    // Insert or overwrite
+    void store( K key, V value )
+    {
+        bool inserted = false;
+        claimSlot( key, inserted ).m_value.store( value, std::memory_order_release );
+    }
+
+    // Add delta to the value for key, starting from V() if it is absent.
+    // Returns the previous value.
+    V fetch_add( K key, V delta )
+    {
+        bool inserted = false;
+        return claimSlot( key, inserted ).m_value.fetch_add( delta, std::memory_order_acq_rel );
+    }
+
+    bool find( K key ) const { return findSlot( key ) != NULL; }
+
+    bool find( K key, V& value ) const
+    {
+        Slot* slot = findSlot( key );
+        if ( slot == NULL ) return false;
+
+        value = slot->m_value.load( std::memory_order_acquire );
+        return true;
+    }
+
+    size_t size() const { return m_size.load( std::memory_order_relaxed ); }
+
+    size_t capacity() const { return m_mask + 1; }
+
+private:
+    size_t                      m_mask;
+    K                           m_emptyKey;
+    std::atomic<size_t>         m_size;
+    std::unique_ptr<Slot[]>     m_slots;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <pthread.h>
+
+// Reader-writer lock. The standard library only gained shared_mutex in
+// C++17, so this wraps the pthreads one. lock/unlock make it usable with
+// std::lock_guard for the exclusive side.
+class RWLock
+{
+public:
+    RWLock();
+    ~RWLock();
+    
+    RWLock( const RWLock& ) = delete;
+    RWLock& operator=( const RWLock& ) = delete;
+    
+    void lock();
+    void unlock();
+    
+    void lock_shared();
+    void unlock_shared();
+    
+private:
+    pthread_rwlock_t    m_lock;
+};
+
+class SharedLockGuard
+{
+public:
+    explicit SharedLockGuard( RWLock& lock ) : m_lock(lock)
+    {
+        m_lock.lock_shared();
+    }
+    
+    ~SharedLockGuard()
+    {
+        m_lock.unlock_shared();
+    }
+    
+    SharedLockGuard( const SharedLockGuard& ) = delete;
+    SharedLockGuard& operator=( const SharedLockGuard& ) = delete;
+    
+private:
+    RWLock&     m_lock;
+};
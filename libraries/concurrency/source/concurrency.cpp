@@ -0,0 +1,32 @@
+#include "rwlock.hpp"
+#include "checks.hpp"
+
+RWLock::RWLock()
+{
+    throwing_assert( pthread_rwlock_init( &m_lock, NULL ) == 0, "Failed to initialise reader-writer lock" );
+}
+
+RWLock::~RWLock()
+{
+    pthread_rwlock_destroy( &m_lock );
+}
+
+void RWLock::lock()
+{
+    throwing_assert( pthread_rwlock_wrlock( &m_lock ) == 0, "Failed to take exclusive lock" );
+}
+
+void RWLock::unlock()
+{
+    pthread_rwlock_unlock( &m_lock );
+}
+
+void RWLock::lock_shared()
+{
+    throwing_assert( pthread_rwlock_rdlock( &m_lock ) == 0, "Failed to take shared lock" );
+}
+
+void RWLock::unlock_shared()
+{
+    pthread_rwlock_unlock( &m_lock );
+}
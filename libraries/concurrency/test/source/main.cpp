@@ -1,5 +1,8 @@
 #include "checks.hpp"
+#include "concurrenthashmap.hpp"
+#include "lockfreehashmap.hpp"
 
+#include <atomic>
 #include <thread>
 #include <future>
 #include <utility>
@@ -127,6 +130,149 @@ void packagedTaskTest()
     foo.join();
 }
 
+void concurrentHashMapTest()
+{
+    ConcurrentHashMap<int, int> m( 16, 2 );
+    
+    const int numThreads = 8;
+    const int perThread = 5000;
+    
+    std::vector<std::thread> threads;
+    for ( int t = 0; t < numThreads; ++t )
+    {
+        threads.push_back( std::thread( [&m, t]()
+        {
+            for ( int i = 0; i < perThread; ++i )
+            {
+                // Disjoint keys per thread, plus a set of shared counters
+                CHECK( m.insert( std::make_pair( t * perThread + i, i ) ) );
+                m.upsert( -1 - (i % 100), []( int& v ) { v += 1; } );
+                
+                int value = 0;
+                CHECK( m.find( t * perThread + i, value ) );
+                CHECK_EQUAL( value, i );
+                
+                if ( i % 2 == 1 ) CHECK( m.erase( t * perThread + i ) );
+            }
+        } ) );
+    }
+    
+    for ( auto& t : threads ) t.join();
+    
+    CHECK_EQUAL( m.size(), static_cast<size_t>( numThreads * perThread / 2 + 100 ) );
+    for ( int i = 0; i < numThreads * perThread; ++i )
+    {
+        CHECK_EQUAL( m.find( i ), i % 2 == 0 );
+    }
+    for ( int i = 0; i < 100; ++i )
+    {
+        int value = 0;
+        CHECK( m.find( -1 - i, value ) );
+        CHECK_EQUAL( value, numThreads * perThread / 100 );
+    }
+    CHECK( !m.insert( std::make_pair( 0, 12 ) ) );
+}
+
+void lockFreeHashMapTest()
+{
+    for ( int numThreads = 1; numThreads <= 64; numThreads *= 2 )
+    {
+        const int numCounters = 500;
+        const int perThread = 2000;
+        LockFreeHashMap<uint64_t, int64_t> m( 4 * (numCounters + numThreads * perThread / 4) );
+        
+        std::vector<std::thread> threads;
+        for ( int t = 0; t < numThreads; ++t )
+        {
+            threads.push_back( std::thread( [&m, t, numThreads]()
+            {
+                for ( int i = 0; i < perThread; ++i )
+                {
+                    // Every thread hammers the same counters, starting from
+                    // a different place so the first inserts race as well
+                    m.fetch_add( (i + t * 7) % numCounters, 1 );
+                    
+                    // And claims some keys of its own
+                    if ( i % 4 == 0 )
+                    {
+                        uint64_t key = 1000000 + t * perThread + i;
+                        CHECK( m.insert( key, static_cast<int64_t>( key ) ) );
+                        CHECK( !m.insert( key, 0 ) );
+                        
+                        int64_t value = 0;
+                        CHECK( m.find( key, value ) );
+                        CHECK_EQUAL( value, static_cast<int64_t>( key ) );
+                    }
+                }
+            } ) );
+        }
+        
+        for ( auto& t : threads ) t.join();
+        
+        CHECK_EQUAL( m.size(), static_cast<size_t>( numCounters + numThreads * perThread / 4 ) );
+        
+        int64_t total = 0;
+        for ( int c = 0; c < numCounters; ++c )
+        {
+            int64_t value = 0;
+            CHECK( m.find( c, value ) );
+            total += value;
+        }
+        CHECK_EQUAL( total, static_cast<int64_t>( numThreads ) * perThread );
+        CHECK( !m.find( numCounters ) );
+    }
+}
+
+// Inserts racing with updates of the same keys. No update may be lost to an
+// insert: either the insert's value went in first and every fetch_add
+// counts on top of it, or an update got there first and the insert
+// reports failure. A store always ends up winning over an insert.
+void lockFreeHashMapRaceTest()
+{
+    for ( int numThreads = 2; numThreads <= 8; numThreads *= 2 )
+    {
+        const int numKeys = 20000;
+        const int64_t inserted = 1000000;
+        LockFreeHashMap<uint64_t, int64_t> m( 4 * numKeys );
+        std::vector<char> insertWon( numKeys, 0 );
+        std::atomic<int> waiting( numThreads );
+        
+        std::vector<std::thread> threads;
+        for ( int t = 0; t < numThreads; ++t )
+        {
+            threads.push_back( std::thread( [&, t]()
+            {
+                waiting--;
+                while ( waiting.load() > 0 ) std::this_thread::yield();
+                
+                for ( int k = 0; k < numKeys; ++k )
+                {
+                    if ( k % 2 == 0 )
+                    {
+                        if ( k % numThreads == t ) insertWon[k] = m.insert( k, inserted );
+                        m.fetch_add( k, 1 );
+                    }
+                    else
+                    {
+                        if ( k % numThreads == t ) m.insert( k, 1 );
+                        if ( (k + 1) % numThreads == t ) m.store( k, 2 );
+                    }
+                }
+            } ) );
+        }
+        
+        for ( auto& t : threads ) t.join();
+        
+        for ( int k = 0; k < numKeys; ++k )
+        {
+            int64_t value = 0;
+            CHECK( m.find( k, value ) );
+            if ( k % 2 == 0 ) CHECK_EQUAL( value, numThreads + (insertWon[k] ? inserted : 0) );
+            else CHECK_EQUAL( value, 2 );
+        }
+    }
+}
+
 #define RUN_TEST( name ) std::cout << "Running: " << #name << std::endl; name();
 
 int main( int /*argc*/, char** /*argv*/ )
@@ -137,6 +283,9 @@ int main( int /*argc*/, char** /*argv*/ )
     RUN_TEST( callOnceTest );
     RUN_TEST( atomicTest );
     RUN_TEST( mutexTest );
+    RUN_TEST( concurrentHashMapTest );
+    RUN_TEST( lockFreeHashMapTest );
+    RUN_TEST( lockFreeHashMapRaceTest );
     std::cerr << "Complete" << std::endl;
 }
 
@@ -0,0 +1,368 @@
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <vector>
+#include <cstddef>
+
+#include "comparators.hpp"
+
+// Once one side of a merge has won this many comparisons in a row the merge
+// starts galloping
+const size_t adaptiveMergeMinGallop = 7;
+
+// The first iterator in [first, last) for which pred is false, where pred
+// holds for a prefix of the range. Probes 1, 2, 4... elements in from the
+// front before binary searching, so it is cheap when the prefix is short.
+template<typename It, typename Pred>
+It gallopFromFront( It first, It last, Pred pred )
+{
+    size_t n = last - first;
+    size_t lo = 0;
+    size_t step = 1;
+    while ( step <= n && pred( first[step - 1] ) )
+    {
+        lo = step;
+        step *= 2;
+    }
+    return std::partition_point( first + lo, first + std::min( step - 1, n ), pred );
+}
+
+// As gallopFromFront, but probing in from the back, for a short suffix
+template<typename It, typename Pred>
+It gallopFromBack( It first, It last, Pred pred )
+{
+    size_t n = last - first;
+    size_t hi = n;
+    size_t step = 1;
+    while ( step <= n && !pred( first[n - step] ) )
+    {
+        hi = n - step;
+        step *= 2;
+    }
+    size_t lo = step <= n ? n - step + 1 : 0;
+    return std::partition_point( first + lo, first + hi, pred );
+}
+
+// Where value goes in the sorted range [first, first + n), after any equal
+// elements. Halving the range without a branch on the comparison lets the
+// compiler use conditional moves, so random input costs no mispredictions.
+template<typename It, typename T, typename Cmp>
+It branchlessUpperBound( It first, size_t n, const T& value, Cmp cmp )
+{
+    if ( n == 0 ) return first;
+
+    while ( n > 1 )
+    {
+        size_t half = n / 2;
+        first = cmp( value, first[half] ) ? first : first + half;
+        n -= half;
+    }
+    return first + (cmp( value, *first ) ? 0 : 1);
+}
+
+// Sort [first, last) given that [first, sorted) already is, inserting each
+// further element after any equal ones
+template<typename It, typename Cmp>
+void binaryInsertionSort( It first, It sorted, It last, Cmp cmp )
+{
+    for ( It i = sorted; i != last; ++i )
+    {
+        It pos = branchlessUpperBound( first, i - first, *i, cmp );
+        if ( pos == i ) continue;
+
+        auto value = std::move( *i );
+        std::move_backward( pos, i, i + 1 );
+        *pos = std::move( value );
+    }
+}
+
+// The state of one adaptiveMergeSort: the stack of runs waiting to be
+// merged, the scratch buffer the smaller side of each merge is moved into,
+// and how readily merges start galloping.
+template<typename It, typename Cmp>
+class AdaptiveMerger
+{
+private:
+    typedef typename std::iterator_traits<It>::value_type T;
+
+    struct Run
+    {
+        It      first;
+        size_t  length;
+    };
+
+public:
+    AdaptiveMerger( Cmp cmp ) : m_cmp(cmp), m_minGallop(adaptiveMergeMinGallop)
+    {
+    }
+
+    void push( It first, size_t length )
+    {
+        Run run = { first, length };
+        m_runs.push_back( run );
+        collapse();
+    }
+
+    // Merge whatever runs are left into one
+    void finish()
+    {
+        while ( m_runs.size() > 1 )
+        {
+            size_t n = m_runs.size() - 2;
+            if ( n > 0 && m_runs[n - 1].length < m_runs[n + 1].length ) n--;
+            mergeAt( n );
+        }
+    }
+
+private:
+    // Merge neighbouring runs until, reading down the stack, each run is
+    // longer than the next and than the next two combined. Run lengths then
+    // grow at least as fast as the Fibonacci numbers, so the stack stays
+    // short and merges stay balanced. (Checking three runs deep rather than
+    // two is the fix for the invariant bug found in the original TimSort.)
+    void collapse()
+    {
+        while ( m_runs.size() > 1 )
+        {
+            size_t n = m_runs.size() - 2;
+            if ( (n > 0 && m_runs[n - 1].length <= m_runs[n].length + m_runs[n + 1].length) ||
+                 (n > 1 && m_runs[n - 2].length <= m_runs[n - 1].length + m_runs[n].length) )
+            {
+                if ( m_runs[n - 1].length < m_runs[n + 1].length ) n--;
+            }
+            else if ( m_runs[n].length > m_runs[n + 1].length )
+            {
+                break;
+            }
+            mergeAt( n );
+        }
+    }
+
+    // Merge runs i and i + 1
+    void mergeAt( size_t i )
+    {
+        It a = m_runs[i].first;
+        It b = m_runs[i + 1].first;
+        It end = b + m_runs[i + 1].length;
+        m_runs[i].length += m_runs[i + 1].length;
+        m_runs.erase( m_runs.begin() + i + 1 );
+
+        // The start of a that is no greater than b's first element, and the
+        // end of b that is no less than a's last, are already in place
+        a = gallopFromFront( a, b, [&]( const T& x ) { return !m_cmp( *b, x ); } );
+        if ( a == b ) return;
+        end = gallopFromBack( b, end, [&]( const T& y ) { return m_cmp( y, *(b - 1) ); } );
+
+        if ( b - a <= end - b ) mergeLow( a, b, end );
+        else mergeHigh( a, b, end );
+    }
+
+    // Merge front to back, with [a, b), the shorter run, moved out to the
+    // buffer
+    void mergeLow( It a, It b, It end )
+    {
+        m_buffer.assign( std::make_move_iterator( a ), std::make_move_iterator( b ) );
+        auto p = m_buffer.begin();
+        auto pEnd = m_buffer.end();
+        It q = b;
+        It out = a;
+
+        // mergeAt trimmed the runs so that a's last element is greater than
+        // all of b, so b always runs out first
+        while ( true )
+        {
+            // One element at a time until one side keeps winning
+            size_t aWins = 0;
+            size_t bWins = 0;
+            do
+            {
+                if ( m_cmp( *q, *p ) )
+                {
+                    *out++ = std::move( *q++ );
+                    bWins++;
+                    aWins = 0;
+                    if ( q == end ) break;
+                }
+                else
+                {
+                    *out++ = std::move( *p++ );
+                    aWins++;
+                    bWins = 0;
+                }
+            }
+            while ( (aWins | bWins) < m_minGallop );
+
+            if ( q == end ) break;
+
+            // Then move whole stretches from each side in turn, for as long
+            // as the stretches stay long. Leaving makes galloping a little
+            // harder to get back into.
+            size_t fromA = 0;
+            size_t fromB = 0;
+            do
+            {
+                auto pStop = gallopFromFront( p, pEnd, [&]( const T& x ) { return !m_cmp( *q, x ); } );
+                fromA = pStop - p;
+                out = std::move( p, pStop, out );
+                p = pStop;
+
+                It qStop = gallopFromFront( q, end, [&]( const T& y ) { return m_cmp( y, *p ); } );
+                fromB = qStop - q;
+                out = std::move( q, qStop, out );
+                q = qStop;
+
+                if ( m_minGallop > 1 ) m_minGallop--;
+            }
+            while ( q != end && (fromA >= adaptiveMergeMinGallop || fromB >= adaptiveMergeMinGallop) );
+
+            if ( q == end ) break;
+            m_minGallop += 2;
+        }
+
+        // Whatever is left of b is already in place
+        std::move( p, pEnd, out );
+    }
+
+    // Merge back to front, with [b, end), the shorter run, moved out to the
+    // buffer
+    void mergeHigh( It a, It b, It end )
+    {
+        m_buffer.assign( std::make_move_iterator( b ), std::make_move_iterator( end ) );
+        It p = b;
+        auto q = m_buffer.end();
+        auto qBegin = m_buffer.begin();
+        It out = end;
+
+        // Likewise b's first element is less than all of a, so a always runs
+        // out first
+        while ( true )
+        {
+            size_t aWins = 0;
+            size_t bWins = 0;
+            do
+            {
+                // Equal elements: b's goes last
+                if ( m_cmp( *(q - 1), *(p - 1) ) )
+                {
+                    *--out = std::move( *--p );
+                    aWins++;
+                    bWins = 0;
+                    if ( p == a ) break;
+                }
+                else
+                {
+                    *--out = std::move( *--q );
+                    bWins++;
+                    aWins = 0;
+                }
+            }
+            while ( (aWins | bWins) < m_minGallop );
+
+            if ( p == a ) break;
+
+            size_t fromA = 0;
+            size_t fromB = 0;
+            do
+            {
+                It pStop = gallopFromBack( a, p, [&]( const T& x ) { return !m_cmp( *(q - 1), x ); } );
+                fromA = p - pStop;
+                out = std::move_backward( pStop, p, out );
+                p = pStop;
+                if ( p == a ) break;
+
+                auto qStop = gallopFromBack( qBegin, q, [&]( const T& y ) { return m_cmp( y, *(p - 1) ); } );
+                fromB = q - qStop;
+                out = std::move_backward( qStop, q, out );
+                q = qStop;
+
+                if ( m_minGallop > 1 ) m_minGallop--;
+            }
+            while ( fromA >= adaptiveMergeMinGallop || fromB >= adaptiveMergeMinGallop );
+
+            if ( p == a ) break;
+            m_minGallop += 2;
+        }
+
+        // Whatever is left of a is already in place
+        std::move_backward( qBegin, q, out );
+    }
+
+private:
+    Cmp                 m_cmp;
+    size_t              m_minGallop;
+    std::vector<Run>    m_runs;
+    std::vector<T>      m_buffer;
+};
+
+// Runs shorter than this are extended with binary insertion sort: a power
+// of two, or a little under, divided into n so the merges come out balanced
+inline size_t adaptiveMinRun( size_t n )
+{
+    size_t remainder = 0;
+    while ( n >= 64 )
+    {
+        remainder |= n & 1;
+        n >>= 1;
+    }
+    return n + remainder;
+}
+
+// Stable merge sort that makes use of order already in the input, in the
+// manner of TimSort. The input is cut into its natural runs: ascending, or
+// strictly descending and reversed in place. Short runs are extended with
+// binary insertion sort, and the runs are merged with galloping, which
+// moves whole stretches of one run at a time once it is clear that they
+// all come before the other run's next element. Sorted input, reversed
+// input, or a few sorted batches end to end take close to n comparisons;
+// random input takes about as many as mergeSort. Needs a buffer of at most
+// n / 2 elements, and elements need only be movable.
+template<typename It, typename Cmp>
+void adaptiveMergeSort( It first, It last, Cmp cmp )
+{
+    size_t n = last - first;
+    if ( n < 2 ) return;
+
+    AdaptiveMerger<It, Cmp> merger( cmp );
+    size_t minRun = adaptiveMinRun( n );
+    It start = first;
+    while ( start != last )
+    {
+        It end = start + 1;
+        if ( end != last )
+        {
+            if ( cmp( *end, *start ) )
+            {
+                while ( end != last && cmp( *end, *(end - 1) ) ) ++end;
+                std::reverse( start, end );
+            }
+            else
+            {
+                while ( end != last && !cmp( *end, *(end - 1) ) ) ++end;
+            }
+        }
+
+        size_t length = end - start;
+        if ( length < minRun )
+        {
+            It sorted = end;
+            end = start + std::min<size_t>( minRun, last - start );
+            binaryInsertionSort( start, sorted, end, cmp );
+            length = end - start;
+        }
+
+        merger.push( start, length );
+        start = end;
+    }
+    merger.finish();
+}
+
+template<typename It>
+void adaptiveMergeSort( It first, It last ) { adaptiveMergeSort( first, last, Less() ); }
+
+template<typename T, typename Cmp>
+void adaptiveMergeSort( std::vector<T>& data, Cmp cmp ) { adaptiveMergeSort( data.begin(), data.end(), cmp ); }
+
+template<typename T>
+void adaptiveMergeSort( std::vector<T>& data ) { adaptiveMergeSort( data.begin(), data.end(), Less() ); }
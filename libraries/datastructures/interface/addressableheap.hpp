@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+#include <cstddef>
+
+#include "checks.hpp"
+#include "heap.hpp"
+
+// A heap (as heap, with Arity children per node) whose elements can be
+// found again after they are pushed: push returns a handle, and the element
+// it names can then be read, given a new value, or erased, each in
+// O(log n). Dijkstra's algorithm and deadline queues can then update an
+// entry in place instead of pushing a duplicate and skipping the stale one
+// when it comes out.
+//
+// Handles index a flat array holding each element's position in the heap,
+// kept up to date as elements move, so there is no allocation per element.
+// A handle is valid until its element is popped or erased, after which the
+// handle may be given to a later push.
+template<typename T, typename Comparison=std::less<T>, size_t Arity=4>
+class AddressableHeap
+{
+    static_assert( Arity >= 2, "A heap needs at least two children per node" );
+
+public:
+    typedef size_t handle_t;
+
+    explicit AddressableHeap( const Comparison& cmp = Comparison() ) : m_cmp(cmp)
+    {
+    }
+
+    handle_t push( T val )
+    {
+        handle_t handle;
+        if ( m_free.empty() )
+        {
+            handle = m_positions.size();
+            m_positions.push_back( 0 );
+        }
+        else
+        {
+            handle = m_free.back();
+            m_free.pop_back();
+        }
+
+        m_entries.push_back( Entry { std::move( val ), handle } );
+        sift_up( m_entries.size() - 1, std::move( m_entries.back() ) );
+        HEAP_CHECKED_ONLY( validate(); )
+        return handle;
+    }
+
+    // The least element, which pop would return, and its handle
+    const T& top() const { return m_entries.front().value; }
+    handle_t topHandle() const { return m_entries.front().handle; }
+
+    T pop()
+    {
+        T next = std::move( m_entries.front().value );
+        remove( 0 );
+        return next;
+    }
+
+    // Whether handle names an element in the heap
+    bool contains( handle_t handle ) const
+    {
+        return handle < m_positions.size() && m_positions[handle] != freePosition();
+    }
+
+    const T& get( handle_t handle ) const
+    {
+        return m_entries[position( handle )].value;
+    }
+
+    // Give the element a value no greater than its current one
+    void decreaseKey( handle_t handle, T val )
+    {
+        size_t index = position( handle );
+        throwing_assert( !m_cmp( m_entries[index].value, val ), "decreaseKey given a greater value" );
+        sift_up( index, Entry { std::move( val ), handle } );
+        HEAP_CHECKED_ONLY( validate(); )
+    }
+
+    // Give the element a value no less than its current one
+    void increaseKey( handle_t handle, T val )
+    {
+        size_t index = position( handle );
+        throwing_assert( !m_cmp( val, m_entries[index].value ), "increaseKey given a lesser value" );
+        sift_down( index, Entry { std::move( val ), handle } );
+        HEAP_CHECKED_ONLY( validate(); )
+    }
+
+    // Give the element any new value
+    void update( handle_t handle, T val )
+    {
+        size_t index = position( handle );
+        place( index, Entry { std::move( val ), handle } );
+        HEAP_CHECKED_ONLY( validate(); )
+    }
+
+    void erase( handle_t handle )
+    {
+        remove( position( handle ) );
+    }
+
+    bool empty() const
+    {
+        return m_entries.empty();
+    }
+
+    size_t size() const
+    {
+        return m_entries.size();
+    }
+
+    void reserve( size_t n )
+    {
+        m_entries.reserve( n );
+        m_positions.reserve( n );
+    }
+
+private:
+    struct Entry
+    {
+        T           value;
+        handle_t    handle;
+    };
+
+    static size_t freePosition() { return std::numeric_limits<size_t>::max(); }
+    static size_t parent( size_t index ) { return (index - 1) / Arity; }
+    static size_t firstChild( size_t index ) { return index * Arity + 1; }
+
+    size_t position( handle_t handle ) const
+    {
+        throwing_assert( contains( handle ), "Handle is not in the heap" );
+        return m_positions[handle];
+    }
+
+    void validate()
+    {
+        for ( size_t i = 0; i < size(); ++i )
+        {
+            CHECK_EQUAL( m_positions[m_entries[i].handle], i );
+            if ( i > 0 ) CHECK( !m_cmp( m_entries[i].value, m_entries[parent( i )].value ) );
+        }
+    }
+
+    // Take the entry at index out of the heap, filling its place with the
+    // last entry
+    void remove( size_t index )
+    {
+        handle_t handle = m_entries[index].handle;
+        Entry last = std::move( m_entries.back() );
+        m_entries.pop_back();
+        if ( index < m_entries.size() ) place( index, std::move( last ) );
+
+        m_positions[handle] = freePosition();
+        m_free.push_back( handle );
+        HEAP_CHECKED_ONLY( validate(); )
+    }
+
+    // Put entry in the hole at index, moving it up or down as it needs
+    void place( size_t index, Entry entry )
+    {
+        if ( index > 0 && m_cmp( entry.value, m_entries[parent( index )].value ) ) sift_up( index, std::move( entry ) );
+        else sift_down( index, std::move( entry ) );
+    }
+
+    void set( size_t index, Entry&& entry )
+    {
+        m_positions[entry.handle] = index;
+        m_entries[index] = std::move( entry );
+    }
+
+    void sift_up( size_t index, Entry entry )
+    {
+        while ( index != 0 && m_cmp( entry.value, m_entries[parent( index )].value ) )
+        {
+            set( index, std::move( m_entries[parent( index )] ) );
+            index = parent( index );
+        }
+        set( index, std::move( entry ) );
+    }
+
+    void sift_down( size_t index, Entry entry )
+    {
+        size_t n = size();
+        while ( true )
+        {
+            size_t first = firstChild( index );
+            if ( first >= n ) break;
+
+            size_t least = first;
+            size_t end = std::min( first + Arity, n );
+            for ( size_t c = first + 1; c < end; ++c )
+            {
+                if ( m_cmp( m_entries[c].value, m_entries[least].value ) ) least = c;
+            }
+
+            if ( !m_cmp( m_entries[least].value, entry.value ) ) break;
+            set( index, std::move( m_entries[least] ) );
+            index = least;
+        }
+        set( index, std::move( entry ) );
+    }
+
+private:
+    Comparison              m_cmp;
+    std::vector<Entry>      m_entries;
+    std::vector<size_t>     m_positions;
+    std::vector<handle_t>   m_free;
+};
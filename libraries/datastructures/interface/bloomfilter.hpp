@@ -0,0 +1,127 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Split block Bloom filter over hashes. Each hash selects one 256 bit block
+// and sets a single bit in each of its eight 32 bit lanes, so a query reads
+// one block (which never straddles a cache line) and with AVX2 tests all
+// eight bits in one go. There are no false negatives, but bits can't be
+// cleared: erase is a no-op and erased hashes stay as false positives until
+// the filter is rebuilt.
+//
+// The hash should be well mixed: the high half picks the block and the low
+// half the bits within it.
+class BlockedBloomFilter
+{
+private:
+    static const size_t lanes = 8;
+    static const size_t blockBytes = lanes * sizeof(uint32_t);
+
+    // Odd multipliers, one per lane, from which the lane's bit is drawn
+    static const uint32_t* salts()
+    {
+        static const uint32_t s[lanes] =
+        {
+            0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+            0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+        };
+        return s;
+    }
+
+    uint32_t* block( size_t hash )
+    {
+        return &m_words[m_offset + blockIndex( hash ) * lanes];
+    }
+
+    const uint32_t* block( size_t hash ) const
+    {
+        return &m_words[m_offset + blockIndex( hash ) * lanes];
+    }
+
+    size_t blockIndex( size_t hash ) const
+    {
+        return static_cast<size_t>( ((static_cast<uint64_t>( hash ) >> 32) * m_numBlocks) >> 32 );
+    }
+
+#if defined(__AVX2__)
+    static __m256i mask( size_t hash )
+    {
+        __m256i bits = _mm256_mullo_epi32( _mm256_set1_epi32( static_cast<uint32_t>( hash ) ),
+            _mm256_loadu_si256( reinterpret_cast<const __m256i*>( salts() ) ) );
+        return _mm256_sllv_epi32( _mm256_set1_epi32( 1 ), _mm256_srli_epi32( bits, 27 ) );
+    }
+#else
+    static uint32_t laneBit( size_t hash, size_t lane )
+    {
+        return 1U << ((static_cast<uint32_t>( hash ) * salts()[lane]) >> 27);
+    }
+#endif
+
+public:
+    // Sized for capacity hashes at roughly bitsPerElement bits each. Twelve
+    // gives a false positive rate of about half a percent at capacity.
+    explicit BlockedBloomFilter( size_t capacity, size_t bitsPerElement = 12 ) :
+        m_capacity( std::max<size_t>( capacity, 1 ) ),
+        m_numBlocks( std::max<size_t>( (m_capacity * bitsPerElement + blockBytes * 8 - 1) / (blockBytes * 8), 1 ) ),
+        m_offset(0)
+    {
+        // Over-allocate by a block so the first can start on a block boundary
+        m_words.resize( (m_numBlocks + 1) * lanes, 0 );
+        size_t misalignment = reinterpret_cast<uintptr_t>( m_words.data() ) % blockBytes;
+        if ( misalignment != 0 ) m_offset = (blockBytes - misalignment) / sizeof(uint32_t);
+    }
+
+    // Moving keeps the words where they are, but a copy could land anywhere
+    BlockedBloomFilter( const BlockedBloomFilter& ) = delete;
+    BlockedBloomFilter& operator=( const BlockedBloomFilter& ) = delete;
+    BlockedBloomFilter( BlockedBloomFilter&& ) = default;
+    BlockedBloomFilter& operator=( BlockedBloomFilter&& ) = default;
+
+    // Never fails, but the false positive rate climbs past capacity
+    bool insert( size_t hash )
+    {
+        uint32_t* b = block( hash );
+#if defined(__AVX2__)
+        __m256i* p = reinterpret_cast<__m256i*>( b );
+        _mm256_storeu_si256( p, _mm256_or_si256( _mm256_loadu_si256( p ), mask( hash ) ) );
+#else
+        for ( size_t i = 0; i < lanes; ++i ) b[i] |= laneBit( hash, i );
+#endif
+        return true;
+    }
+
+    bool mayContain( size_t hash ) const
+    {
+        const uint32_t* b = block( hash );
+#if defined(__AVX2__)
+        return _mm256_testc_si256( _mm256_loadu_si256( reinterpret_cast<const __m256i*>( b ) ), mask( hash ) ) != 0;
+#else
+        // Accumulate rather than exit early, so the lanes can be vectorised
+        uint32_t missing = 0;
+        for ( size_t i = 0; i < lanes; ++i )
+        {
+            uint32_t bit = laneBit( hash, i );
+            missing |= (b[i] & bit) ^ bit;
+        }
+        return missing == 0;
+#endif
+    }
+
+    // Bits are shared between hashes, so nothing can be removed
+    bool erase( size_t /*hash*/ ) { return false; }
+
+    size_t capacity() const { return m_capacity; }
+
+private:
+    size_t                  m_capacity;
+    size_t                  m_numBlocks;
+    size_t                  m_offset;
+    std::vector<uint32_t>   m_words;
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <utility>
+
+// operator< on whatever it is given, for the sorts' default ordering (the
+// standard library only gains a transparent std::less<> in C++14)
+struct Less
+{
+    template<typename A, typename B>
+    bool operator()( const A& a, const B& b ) const { return a < b; }
+};
+
+// Orders elements by a key extracted from each with key, compared with cmp
+template<typename Key, typename Cmp>
+class KeyCompare
+{
+public:
+    KeyCompare( Key key, Cmp cmp ) : m_key(key), m_cmp(cmp)
+    {
+    }
+
+    template<typename T>
+    bool operator()( const T& a, const T& b ) const { return m_cmp( m_key( a ), m_key( b ) ); }
+
+private:
+    Key     m_key;
+    Cmp     m_cmp;
+};
+
+// Sort by a projection of each element, e.g.
+//
+//   mergeSort( records.begin(), records.end(), byKey( []( const Record& r ) { return r.timestamp; } ) );
+template<typename Key>
+KeyCompare<Key, Less> byKey( Key key ) { return KeyCompare<Key, Less>( key, Less() ); }
+
+template<typename Key, typename Cmp>
+KeyCompare<Key, Cmp> byKey( Key key, Cmp cmp ) { return KeyCompare<Key, Cmp>( key, cmp ); }
+
+// The opposite order to cmp, e.g. to keep the greatest of a set on top of a
+// heap that keeps the least there
+template<typename Cmp>
+class Reversed
+{
+public:
+    explicit Reversed( Cmp cmp ) : m_cmp(cmp)
+    {
+    }
+
+    template<typename A, typename B>
+    bool operator()( const A& a, const B& b ) const { return m_cmp( b, a ); }
+
+private:
+    Cmp     m_cmp;
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// One control byte per slot of an open addressing table. Full slots hold
+// 7 bits of the key hash (0..127), so the empty marker can be told apart from
+// them by the sign bit alone. A lookup compares a whole group of control bytes
+// against the tag at once and only touches key memory for the (rare) slots
+// whose tag matches.
+namespace ctrl
+{
+    typedef int8_t ctrl_t;
+    typedef uint16_t dist_t;
+
+    static const ctrl_t kEmpty = -128;
+    static const dist_t kMaxDist = 0xFFFF;
+
+    inline bool isFull( ctrl_t c ) { return c >= 0; }
+
+    // Tag bits are taken from the top of a multiplicative mix so that they
+    // stay independent of the low bits used to pick the home bucket (which
+    // matters for identity hashes such as std::hash<int>).
+    inline ctrl_t tag( size_t hash )
+    {
+        return static_cast<ctrl_t>( (static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ULL) >> 57 );
+    }
+
+    // Iterate the set bits of a group match, lowest slot first
+    class BitMask
+    {
+    public:
+        explicit BitMask( uint32_t mask ) : m_mask(mask)
+        {
+        }
+
+        bool any() const { return m_mask != 0; }
+        uint32_t bits() const { return m_mask; }
+        size_t lowest() const { return __builtin_ctz( m_mask ); }
+        void next() { m_mask &= (m_mask - 1); }
+
+    private:
+        uint32_t m_mask;
+    };
+
+    class Group
+    {
+    public:
+        static const size_t width = 16;
+
+        explicit Group( const ctrl_t* pos )
+        {
+#if defined(__SSE2__)
+            m_ctrl = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pos ) );
+#else
+            for ( size_t i = 0; i < width; ++i ) m_ctrl[i] = pos[i];
+#endif
+        }
+
+        BitMask match( ctrl_t h2 ) const
+        {
+#if defined(__SSE2__)
+            return BitMask( _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_set1_epi8( h2 ), m_ctrl ) ) );
+#else
+            return scalarMatch( [h2]( ctrl_t c ) { return c == h2; } );
+#endif
+        }
+
+        BitMask matchEmpty() const
+        {
+#if defined(__SSE2__)
+            return BitMask( _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_set1_epi8( kEmpty ), m_ctrl ) ) );
+#else
+            return scalarMatch( []( ctrl_t c ) { return c == kEmpty; } );
+#endif
+        }
+
+    private:
+#if defined(__SSE2__)
+        __m128i     m_ctrl;
+#else
+        template<typename Pred>
+        BitMask scalarMatch( Pred pred ) const
+        {
+            uint32_t mask = 0;
+            for ( size_t i = 0; i < width; ++i )
+            {
+                if ( pred( m_ctrl[i] ) ) mask |= (1U << i);
+            }
+            return BitMask( mask );
+        }
+
+        ctrl_t      m_ctrl[width];
+#endif
+    };
+
+    // The probe distances of a group of slots, as kept alongside the control
+    // bytes by a Robin Hood table.
+    class DistanceGroup
+    {
+    public:
+        explicit DistanceGroup( const dist_t* pos ) : m_pos(pos)
+        {
+        }
+
+        // Slots whose element lies closer to its home than offset + lane,
+        // i.e. those a key that has probed that far could not be beyond.
+        BitMask matchBelow( size_t offset ) const
+        {
+            dist_t base = static_cast<dist_t>( std::min<size_t>( offset, kMaxDist ) );
+#if defined(__SSE2__)
+            const __m128i* pos = reinterpret_cast<const __m128i*>( m_pos );
+            __m128i probeLo = _mm_adds_epu16( _mm_set1_epi16( base ), _mm_setr_epi16( 0, 1, 2, 3, 4, 5, 6, 7 ) );
+            __m128i probeHi = _mm_adds_epu16( _mm_set1_epi16( base ), _mm_setr_epi16( 8, 9, 10, 11, 12, 13, 14, 15 ) );
+
+            // Saturating subtraction is zero exactly where dist >= probe
+            __m128i zero = _mm_setzero_si128();
+            __m128i atLeastLo = _mm_cmpeq_epi16( _mm_subs_epu16( probeLo, _mm_loadu_si128( pos ) ), zero );
+            __m128i atLeastHi = _mm_cmpeq_epi16( _mm_subs_epu16( probeHi, _mm_loadu_si128( pos + 1 ) ), zero );
+            return BitMask( ~_mm_movemask_epi8( _mm_packs_epi16( atLeastLo, atLeastHi ) ) & 0xFFFF );
+#else
+            uint32_t mask = 0;
+            for ( size_t i = 0; i < Group::width; ++i )
+            {
+                if ( m_pos[i] < std::min<size_t>( base + i, kMaxDist ) ) mask |= (1U << i);
+            }
+            return BitMask( mask );
+#endif
+        }
+
+    private:
+        const dist_t*   m_pos;
+    };
+}
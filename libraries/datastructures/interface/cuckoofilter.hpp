@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Cuckoo filter over hashes, which unlike a Bloom filter supports erase.
+// Each hash is reduced to a 16 bit fingerprint that can live in either of
+// two buckets of four, the second found from the first and the fingerprint
+// alone, so fingerprints can be moved between them without the original
+// hash. A bucket is one 64 bit word and all four slots are compared at once,
+// so a query reads at most two words.
+//
+// When an insert can't find room after a bounded number of evictions the
+// last evicted fingerprint is parked in a one-entry stash and the filter
+// reports itself full; nothing already inserted is ever lost. Only erase
+// hashes that were inserted, or a colliding fingerprint may be removed.
+class CuckooFilter
+{
+private:
+    typedef uint16_t fingerprint_t;
+
+    static const size_t slotsPerBucket = 4;
+    static const size_t maxKicks = 500;
+    static const uint64_t lowBits = 0x0001000100010001ULL;
+    static const uint64_t highBits = 0x8000800080008000ULL;
+
+    // Zero marks an empty slot, so fingerprints are never zero
+    static fingerprint_t fingerprint( size_t hash )
+    {
+        fingerprint_t fp = static_cast<fingerprint_t>( static_cast<uint64_t>( hash ) >> 48 );
+        return fp == 0 ? 1 : fp;
+    }
+
+    // Its own inverse, so either bucket leads to the other
+    size_t altIndex( size_t index, fingerprint_t fp ) const
+    {
+        return (index ^ (static_cast<size_t>( fp ) * 0x5bd1e995U)) & m_mask;
+    }
+
+    static fingerprint_t slot( uint64_t bucket, size_t i )
+    {
+        return static_cast<fingerprint_t>( bucket >> (16 * i) );
+    }
+
+    static void setSlot( uint64_t& bucket, size_t i, fingerprint_t fp )
+    {
+        bucket = (bucket & ~(0xFFFFULL << (16 * i))) | (static_cast<uint64_t>( fp ) << (16 * i));
+    }
+
+    // Whether any slot of bucket holds fp (SWAR zero-lane test on the xor)
+    static bool holds( uint64_t bucket, fingerprint_t fp )
+    {
+        uint64_t x = bucket ^ (fp * lowBits);
+        return ((x - lowBits) & ~x & highBits) != 0;
+    }
+
+    bool place( size_t index, fingerprint_t fp )
+    {
+        uint64_t& bucket = m_buckets[index];
+        for ( size_t i = 0; i < slotsPerBucket; ++i )
+        {
+            if ( slot( bucket, i ) == 0 )
+            {
+                setSlot( bucket, i, fp );
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool remove( size_t index, fingerprint_t fp )
+    {
+        uint64_t& bucket = m_buckets[index];
+        for ( size_t i = 0; i < slotsPerBucket; ++i )
+        {
+            if ( slot( bucket, i ) == fp )
+            {
+                setSlot( bucket, i, 0 );
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // xorshift64, to pick eviction victims
+    size_t random()
+    {
+        m_rng ^= m_rng << 13;
+        m_rng ^= m_rng >> 7;
+        m_rng ^= m_rng << 17;
+        return static_cast<size_t>( m_rng );
+    }
+
+public:
+    // Buckets are kept at most ~95% full, which four-slot buckets reach
+    // without running out of evictions.
+    explicit CuckooFilter( size_t capacity ) :
+        m_capacity( std::max<size_t>( capacity, 1 ) ),
+        m_mask(0),
+        m_hasVictim(false),
+        m_victimIndex(0),
+        m_victim(0),
+        m_rng(0x9E3779B97F4A7C15ULL)
+    {
+        size_t numBuckets = 1;
+        while ( numBuckets * slotsPerBucket * 95 < m_capacity * 100 ) numBuckets *= 2;
+        m_mask = numBuckets - 1;
+        m_buckets.resize( numBuckets, 0 );
+    }
+
+    // Returns false, storing nothing, once the filter is full
+    bool insert( size_t hash )
+    {
+        if ( m_hasVictim ) return false;
+
+        fingerprint_t fp = fingerprint( hash );
+        size_t index = hash & m_mask;
+        if ( place( index, fp ) ) return true;
+        index = altIndex( index, fp );
+        if ( place( index, fp ) ) return true;
+
+        // Both full: evict a random occupant to its other bucket, and so on
+        for ( size_t kick = 0; kick < maxKicks; ++kick )
+        {
+            size_t victimSlot = random() % slotsPerBucket;
+            fingerprint_t evicted = slot( m_buckets[index], victimSlot );
+            setSlot( m_buckets[index], victimSlot, fp );
+            fp = evicted;
+            index = altIndex( index, fp );
+            if ( place( index, fp ) ) return true;
+        }
+
+        // The hash itself is in, but the last evictee has nowhere to go
+        m_hasVictim = true;
+        m_victimIndex = index;
+        m_victim = fp;
+        return true;
+    }
+
+    bool mayContain( size_t hash ) const
+    {
+        fingerprint_t fp = fingerprint( hash );
+        size_t i1 = hash & m_mask;
+        size_t i2 = altIndex( i1, fp );
+        if ( holds( m_buckets[i1], fp ) || holds( m_buckets[i2], fp ) ) return true;
+        return m_hasVictim && m_victim == fp && (m_victimIndex == i1 || m_victimIndex == i2);
+    }
+
+    bool erase( size_t hash )
+    {
+        fingerprint_t fp = fingerprint( hash );
+        size_t i1 = hash & m_mask;
+        size_t i2 = altIndex( i1, fp );
+
+        bool found = remove( i1, fp ) || remove( i2, fp );
+        if ( !found && m_hasVictim && m_victim == fp && (m_victimIndex == i1 || m_victimIndex == i2) )
+        {
+            m_hasVictim = false;
+            return true;
+        }
+
+        // A slot has freed up, which may be all the stashed victim needed
+        if ( found && m_hasVictim && (place( m_victimIndex, m_victim ) || place( altIndex( m_victimIndex, m_victim ), m_victim )) )
+        {
+            m_hasVictim = false;
+        }
+        return found;
+    }
+
+    bool full() const { return m_hasVictim; }
+
+    size_t capacity() const { return m_capacity; }
+
+private:
+    size_t                  m_capacity;
+    size_t                  m_mask;
+    std::vector<uint64_t>   m_buckets;
+    bool                    m_hasVictim;
+    size_t                  m_victimIndex;
+    fingerprint_t           m_victim;
+    uint64_t                m_rng;
+};
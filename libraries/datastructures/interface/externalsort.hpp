@@ -0,0 +1,208 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#include "checks.hpp"
+#include "comparators.hpp"
+#include "heap.hpp"
+#include "quicksort.hpp"
+#include "sequentialfile.hpp"
+
+// Merges of fewer than this many bytes per run spend more time seeking
+// between runs than reading, so runs beyond budget / this are merged in more
+// than one pass
+const size_t externalSortMinReadBytes = 1 << 16;
+
+struct ExternalSortStats
+{
+    uint64_t    records;
+    size_t      runs;
+    size_t      mergePasses;
+};
+
+namespace externalsort
+{
+    // Run files, removed when the sort finishes or fails
+    class TempFiles
+    {
+    public:
+        explicit TempFiles( const std::string& prefix ) : m_prefix(prefix), m_next(0)
+        {
+        }
+
+        ~TempFiles()
+        {
+            for ( const auto& path : m_paths ) std::remove( path.c_str() );
+        }
+
+        TempFiles( const TempFiles& ) = delete;
+        TempFiles& operator=( const TempFiles& ) = delete;
+
+        std::string create()
+        {
+            m_paths.push_back( m_prefix + std::to_string( m_next++ ) );
+            return m_paths.back();
+        }
+
+        void remove( const std::string& path )
+        {
+            std::remove( path.c_str() );
+            m_paths.erase( std::find( m_paths.begin(), m_paths.end(), path ) );
+        }
+
+    private:
+        std::string                 m_prefix;
+        size_t                      m_next;
+        std::vector<std::string>    m_paths;
+    };
+
+    // One run being merged: its records a block at a time
+    template<typename T>
+    class RunCursor
+    {
+    public:
+        RunCursor( const std::string& path, size_t blockRecords ) :
+            m_reader( path, blockRecords * sizeof(T) ),
+            m_block( blockRecords ),
+            m_pos(0),
+            m_count(0)
+        {
+        }
+
+        const T& current() const { return m_block[m_pos]; }
+
+        // Step to the next record, returning false at the end of the run
+        bool advance()
+        {
+            if ( ++m_pos < m_count ) return true;
+
+            m_count = m_reader.read( reinterpret_cast<char*>( m_block.data() ), m_block.size() * sizeof(T) ) / sizeof(T);
+            m_pos = 0;
+            return m_count > 0;
+        }
+
+    private:
+        SequentialReader    m_reader;
+        std::vector<T>      m_block;
+        size_t              m_pos;
+        size_t              m_count;
+    };
+
+    // Merge the runs at paths into out, with a heap of run indices ordered by
+    // each run's current record as the tournament
+    template<typename T, typename Cmp>
+    void mergeRunFiles( const std::vector<std::string>& paths, size_t blockRecords, SequentialWriter& out, Cmp cmp )
+    {
+        std::vector<std::unique_ptr<RunCursor<T>>> runs;
+        for ( const auto& path : paths ) runs.emplace_back( new RunCursor<T>( path, blockRecords ) );
+
+        auto order = [&]( size_t a, size_t b ) { return cmp( runs[a]->current(), runs[b]->current() ); };
+
+        heap<size_t, decltype( order )> tournament( order );
+        for ( size_t r = 0; r < runs.size(); ++r )
+        {
+            if ( runs[r]->advance() ) tournament.push( r );
+        }
+
+        while ( !tournament.empty() )
+        {
+            size_t r = tournament.pop();
+            out.write( reinterpret_cast<const char*>( &runs[r]->current() ), sizeof(T) );
+            if ( runs[r]->advance() ) tournament.push( r );
+        }
+    }
+}
+
+// Sorts a file of fixed-size records (the raw bytes of trivially copyable
+// Ts) into outputPath, holding no more than about memoryBudget bytes of
+// records and buffers at once.
+//
+// The input is read in runs that fill the budget, less the output buffers,
+// and each run is sorted in memory and written to a temporary file next to
+// the output. The runs are then merged k at a time, where k is as many as
+// the budget can give a read buffer of externalSortMinReadBytes each, in as
+// many passes as it takes. Reads hint the kernel to fetch the next block
+// ahead, and writes go out on a background thread while the next block
+// fills. The sort is not stable.
+template<typename T, typename Cmp>
+ExternalSortStats externalSort( const std::string& inputPath, const std::string& outputPath, size_t memoryBudget, Cmp cmp )
+{
+    static_assert( std::is_trivially_copyable<T>::value, "externalSort records are read and written as raw bytes" );
+
+    // A sixteenth each for the two output buffers, the rest for records
+    size_t writeBytes = std::max( memoryBudget / 16, sizeof(T) );
+    throwing_assert( memoryBudget >= writeBytes * 2 + sizeof(T) * 4, "externalSort memory budget is too small" );
+    size_t recordBytes = memoryBudget - writeBytes * 2;
+
+    externalsort::TempFiles temps( outputPath + ".run" );
+    std::vector<std::string> runs;
+    ExternalSortStats stats = { 0, 0, 0 };
+    {
+        size_t runRecords = recordBytes / sizeof(T);
+        std::vector<T> run( runRecords );
+        SequentialReader in( inputPath, recordBytes );
+        throwing_assert( in.size() % sizeof(T) == 0, inputPath + " is not a whole number of records" );
+
+        while ( true )
+        {
+            size_t n = in.read( reinterpret_cast<char*>( run.data() ), runRecords * sizeof(T) ) / sizeof(T);
+            if ( n == 0 && !runs.empty() ) break;
+
+            quickSort( run.begin(), run.begin() + n, cmp );
+            stats.records += n;
+
+            // Input that fits in one run needs no merge
+            bool only = runs.empty() && stats.records == in.size() / sizeof(T);
+            std::string path = only ? outputPath : temps.create();
+            SequentialWriter out( path, writeBytes );
+            out.write( reinterpret_cast<const char*>( run.data() ), n * sizeof(T) );
+            out.close();
+            runs.push_back( path );
+            if ( only ) break;
+        }
+    }
+    stats.runs = runs.size();
+    if ( runs.size() == 1 ) return stats;
+
+    // Every run being merged needs room for at least one record, which for
+    // records bigger than externalSortMinReadBytes narrows the merge further.
+    // The budget check above leaves room for at least four.
+    size_t fanIn = std::min( std::max<size_t>( 2, recordBytes / externalSortMinReadBytes ), recordBytes / sizeof(T) );
+    while ( true )
+    {
+        stats.mergePasses++;
+        size_t k = std::min( fanIn, runs.size() );
+        size_t blockRecords = recordBytes / k / sizeof(T);
+
+        std::vector<std::string> merged;
+        for ( size_t start = 0; start < runs.size(); start += k )
+        {
+            std::vector<std::string> group( runs.begin() + start, runs.begin() + std::min( start + k, runs.size() ) );
+            bool last = runs.size() <= k;
+            std::string path = last ? outputPath : temps.create();
+
+            SequentialWriter out( path, writeBytes );
+            externalsort::mergeRunFiles<T>( group, blockRecords, out, cmp );
+            out.close();
+
+            for ( const auto& done : group ) temps.remove( done );
+            merged.push_back( path );
+        }
+
+        if ( merged.size() == 1 ) return stats;
+        runs.swap( merged );
+    }
+}
+
+template<typename T>
+ExternalSortStats externalSort( const std::string& inputPath, const std::string& outputPath, size_t memoryBudget )
+{
+    return externalSort<T>( inputPath, outputPath, memoryBudget, Less() );
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <cstddef>
+
+#include "checks.hpp"
+#include "hashing.hpp"
+#include "bloomfilter.hpp"
+#include "cuckoofilter.hpp"
+
+// Puts a filter (BlockedBloomFilter or CuckooFilter) in front of a HashTable
+// or OpenAddressingHashTable, so that lookups for absent keys usually return
+// after reading a single filter block instead of walking a chain or probe
+// run. Worth it when most lookups miss.
+//
+// Every key in the table is also in the filter. Once the filter has taken
+// as many hashes as it was sized for it is rebuilt from the table's contents
+// at twice the table's size, which also clears out any hashes a Bloom filter
+// is still holding for erased keys.
+template<typename Table, typename Filter = BlockedBloomFilter>
+class FilteredHashTable
+{
+private:
+    typedef typename Table::key_type K;
+    typedef typename Table::mapped_type V;
+
+    static const size_t initialFilterCapacity = 1024;
+
+    // The table's hash, mixed again so that filters stay usable even when
+    // the table runs on an identity hash
+    template<typename Q>
+    size_t filterHash( const Q& key ) const { return static_cast<size_t>( mix64( m_hashFn( key ) ) ); }
+
+    void filterInsert( size_t hash )
+    {
+        if ( m_filtered < m_filter.capacity() && m_filter.insert( hash ) )
+        {
+            m_filtered++;
+            return;
+        }
+
+        // Either over capacity or (for a cuckoo filter) full. The table
+        // already holds the new key, so the rebuild picks it up.
+        rebuildFilter( std::max( size_t( initialFilterCapacity ), static_cast<size_t>( m_table.size() ) * 2 ) );
+    }
+
+    void rebuildFilter( size_t capacity )
+    {
+        Filter fresh( capacity );
+        size_t filtered = 0;
+        m_table.for_each( [&]( const K& key, V& )
+        {
+            throwing_assert( fresh.insert( filterHash( key ) ), "Rebuilt hash table filter is full" );
+            filtered++;
+        } );
+
+        m_filter = std::move( fresh );
+        m_filtered = filtered;
+    }
+
+public:
+    // Arguments are passed on to the table's constructor
+    template<typename... Args>
+    explicit FilteredHashTable( Args&&... args ) :
+        m_table( std::forward<Args>(args)... ),
+        m_filter( initialFilterCapacity ),
+        m_filtered(0)
+    {
+    }
+
+    // Inserts without checking for an existing copy of the key
+    void insert( const std::pair<K, V>& kv )
+    {
+        size_t hash = filterHash( kv.first );
+        m_table.insert( kv );
+        filterInsert( hash );
+    }
+
+    void insert( std::pair<K, V>&& kv )
+    {
+        size_t hash = filterHash( kv.first );
+        m_table.insert( std::move(kv) );
+        filterInsert( hash );
+    }
+
+    template<typename... Args>
+    std::pair<V*, bool> try_emplace( const K& key, Args&&... args )
+    {
+        auto r = m_table.try_emplace( key, std::forward<Args>(args)... );
+        if ( r.second ) filterInsert( filterHash( key ) );
+        return r;
+    }
+
+    // The key is hashed for the filter before it is moved into the table.
+    // The filter insert itself has to follow the table's, since a filter
+    // rebuild reads the keys back out of the table.
+    template<typename... Args>
+    std::pair<V*, bool> try_emplace( K&& key, Args&&... args )
+    {
+        size_t hash = filterHash( key );
+        auto r = m_table.try_emplace( std::move(key), std::forward<Args>(args)... );
+        if ( r.second ) filterInsert( hash );
+        return r;
+    }
+
+    V& operator[]( const K& key ) { return *try_emplace( key ).first; }
+
+    template<typename Q>
+    bool find( const Q& key ) { return m_filter.mayContain( filterHash( key ) ) && m_table.find( key ); }
+
+    // The value for key, or NULL if it is absent
+    template<typename Q>
+    V* findPtr( const Q& key ) { return m_filter.mayContain( filterHash( key ) ) ? m_table.findPtr( key ) : NULL; }
+
+    template<typename Q>
+    V& get( const Q& key )
+    {
+        V* value = findPtr( key );
+        throwing_assert( value != NULL, "Key not present in hashtable" );
+        return *value;
+    }
+
+    template<typename Q>
+    bool erase( const Q& key )
+    {
+        size_t hash = filterHash( key );
+        if ( !m_filter.mayContain( hash ) || !m_table.erase( key ) ) return false;
+
+        if ( m_filter.erase( hash ) ) m_filtered--;
+        return true;
+    }
+
+    size_t size() { return static_cast<size_t>( m_table.size() ); }
+
+    const Table& table() const { return m_table; }
+
+    const Filter& filter() const { return m_filter; }
+
+private:
+    Table                       m_table;
+    Filter                      m_filter;
+    size_t                      m_filtered;
+    typename Table::hasher      m_hashFn;
+};
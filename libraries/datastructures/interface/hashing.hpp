@@ -0,0 +1,143 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+
+// Hashes std::string and C strings identically, so that tables keyed on
+// std::string can be probed with a const char* without first building a
+// temporary string (heterogeneous lookup).
+struct StringHash
+{
+    size_t operator()( const std::string& s ) const { return bytes( s.data(), s.size() ); }
+    size_t operator()( const char* s ) const { return bytes( s, std::strlen( s ) ); }
+
+    // 64 bit FNV-1a
+    static size_t bytes( const char* data, size_t length )
+    {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for ( size_t i = 0; i < length; ++i )
+        {
+            h ^= static_cast<unsigned char>( data[i] );
+            h *= 0x100000001b3ULL;
+        }
+        return static_cast<size_t>( h );
+    }
+};
+
+// The murmur3 64 bit finaliser: every input bit affects every output bit
+inline uint64_t mix64( uint64_t h )
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Default hash for the tables. std::hash is the identity for integers on
+// libstdc++, so sequential keys land in sequential buckets and masking off
+// the low bits throws the rest away. Integers, enums and pointers are
+// therefore run through mix64; anything else uses std::hash as is.
+template<typename K, bool Mix = std::is_integral<K>::value || std::is_enum<K>::value || std::is_pointer<K>::value>
+struct DefaultHash
+{
+    size_t operator()( const K& k ) const { return std::hash<K>()( k ); }
+};
+
+template<typename K>
+struct DefaultHash<K, true>
+{
+    size_t operator()( const K& k ) const { return static_cast<size_t>( mix64( std::hash<K>()( k ) ) ); }
+};
+
+// Bucket reduction policies map a hash onto [0, numBuckets). Each picks the
+// bucket counts it supports through bucketCount(), and is constructed with
+// one of them.
+
+// Mask off the low bits of the hash: no division, but relies on the low
+// bits being well mixed (as DefaultHash makes them).
+class PowerOfTwoReduction
+{
+public:
+    explicit PowerOfTwoReduction( size_t numBuckets = 1 ) : m_mask( numBuckets - 1 )
+    {
+    }
+
+    static size_t bucketCount( size_t requested )
+    {
+        size_t count = 1;
+        while ( count < requested ) count *= 2;
+        return count;
+    }
+
+    size_t operator()( size_t hash ) const { return hash & m_mask; }
+
+private:
+    size_t  m_mask;
+};
+
+// Lemire's fastrange: the high half of hash * numBuckets. Any bucket count,
+// no division, but uses the high bits of the hash.
+class FastRangeReduction
+{
+public:
+    explicit FastRangeReduction( size_t numBuckets = 1 ) : m_numBuckets( numBuckets )
+    {
+    }
+
+    static size_t bucketCount( size_t requested ) { return std::max<size_t>( requested, 1 ); }
+
+    size_t operator()( size_t hash ) const
+    {
+        return static_cast<size_t>( (static_cast<unsigned __int128>( hash ) * m_numBuckets) >> 64 );
+    }
+
+private:
+    uint64_t    m_numBuckets;
+};
+
+// Modulo a prime: pays for a division, but uses every bit of the hash, so
+// it copes with weak hash functions that can't be changed.
+class PrimeReduction
+{
+public:
+    explicit PrimeReduction( size_t numBuckets = 1 ) : m_numBuckets( numBuckets )
+    {
+    }
+
+    // Primes roughly doubling from 2 up to just under 2^63
+    static size_t bucketCount( size_t requested )
+    {
+        static const uint64_t primes[] =
+        {
+            2ULL, 5ULL, 11ULL, 23ULL, 53ULL, 97ULL, 193ULL, 389ULL, 769ULL, 1543ULL, 3079ULL,
+            6151ULL, 12289ULL, 24593ULL, 49157ULL, 98317ULL, 196613ULL, 393241ULL, 786433ULL,
+            1572869ULL, 3145739ULL, 6291469ULL, 12582917ULL, 25165843ULL, 50331653ULL, 100663319ULL,
+            201326611ULL, 402653189ULL, 805306457ULL, 1610612741ULL, 3221225533ULL, 6442451077ULL,
+            12884902183ULL, 25769804377ULL, 51539608777ULL, 103079217557ULL, 206158435127ULL,
+            412316870257ULL, 824633740543ULL, 1649267481107ULL, 3298534962241ULL, 6597069924499ULL,
+            13194139849019ULL, 26388279698083ULL, 52776559396247ULL, 105553118792503ULL,
+            211106237585011ULL, 422212475170033ULL, 844424950340077ULL, 1688849900680177ULL,
+            3377699801360363ULL, 6755399602720733ULL, 13510799205441479ULL, 27021598410882961ULL,
+            54043196821766041ULL, 108086393643532111ULL, 216172787287064273ULL,
+            432345574574128661ULL, 864691149148257371ULL, 1729382298296514749ULL,
+            3458764596593029531ULL, 6917529193186059067ULL
+        };
+        for ( uint64_t p : primes )
+        {
+            if ( p >= requested ) return static_cast<size_t>( p );
+        }
+        return static_cast<size_t>( primes[sizeof(primes) / sizeof(primes[0]) - 1] );
+    }
+
+    size_t operator()( size_t hash ) const { return hash % m_numBuckets; }
+
+private:
+    size_t  m_numBuckets;
+};
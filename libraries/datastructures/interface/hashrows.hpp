@@ -0,0 +1,345 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "checks.hpp"
+
+// Bucket storage for the chained HashTable. A row store owns every chain of
+// one bucket array and is addressed by bucket index:
+//
+//   find( b, key )         The element in bucket b with key, or NULL
+//   emplace( b, args... )  Append an element built from args to bucket b
+//   erase( b, key )        Remove the element with key from bucket b
+//   drainBack( fn )        Move each element of the last bucket into fn, then
+//                          remove the bucket
+//   forEach( b, fn )       Call fn on each element of bucket b
+//   address( b )           Where bucket b starts, for prefetching
+//   length( b )            The number of elements in bucket b
+//   size()                 The number of buckets (zero when default constructed)
+//   allocate( n, cap )     Reserve room for n buckets without making any
+//   prepare( count )       Make up to count more of them, returning whether
+//                          all n are there
+//
+// Pointers to elements stay valid until the next emplace or erase.
+
+// Each bucket is its own vector: one allocation per non-empty bucket, and a
+// lookup reads the bucket header before chasing it to the elements.
+template<typename K, typename V>
+class VectorRows
+{
+private:
+    class HashRow
+    {
+    public:
+        HashRow( size_t defaultCapacity )
+        {
+            m_slots.reserve( defaultCapacity );
+        }
+
+        template<typename... Args>
+        std::pair<K, V>& emplace( Args&&... args )
+        {
+            m_slots.emplace_back( std::forward<Args>(args)... );
+            return m_slots.back();
+        }
+
+        template<typename Q>
+        bool erase( const Q& key )
+        {
+            for ( auto it = m_slots.begin(); it != m_slots.end(); ++it )
+            {
+                if ( it->first == key )
+                {
+                    m_slots.erase(it);
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        template<typename Q>
+        std::pair<K, V>* findSlot( const Q& key )
+        {
+            for ( size_t i = 0; i < m_slots.size(); ++i )
+            {
+                if ( m_slots[i].first == key )
+                {
+                    return &m_slots[i];
+                }
+            }
+            return NULL;
+        }
+
+        std::vector<std::pair<K, V>>& slots() { return m_slots; }
+        const std::vector<std::pair<K, V>>& slots() const { return m_slots; }
+
+    private:
+        std::vector<std::pair<K, V>> m_slots;
+    };
+
+public:
+    VectorRows() : m_allocated(0), m_bucketCapacity(0)
+    {
+    }
+
+    VectorRows( size_t numBuckets, size_t bucketCapacity ) :
+        m_rows( numBuckets, HashRow(bucketCapacity) ),
+        m_allocated(numBuckets),
+        m_bucketCapacity(bucketCapacity)
+    {
+    }
+
+    void allocate( size_t numBuckets, size_t bucketCapacity )
+    {
+        m_rows.reserve( numBuckets );
+        m_allocated = numBuckets;
+        m_bucketCapacity = bucketCapacity;
+    }
+
+    bool prepare( size_t count )
+    {
+        size_t end = m_rows.size() + std::min( count, m_allocated - m_rows.size() );
+        m_rows.resize( end, HashRow(m_bucketCapacity) );
+        return end == m_allocated;
+    }
+
+    template<typename Q>
+    std::pair<K, V>* find( size_t b, const Q& key ) { return m_rows[b].findSlot( key ); }
+
+    template<typename... Args>
+    std::pair<K, V>& emplace( size_t b, Args&&... args ) { return m_rows[b].emplace( std::forward<Args>(args)... ); }
+
+    template<typename Q>
+    bool erase( size_t b, const Q& key ) { return m_rows[b].erase( key ); }
+
+    // Removing each row as it empties releases its memory now, and leaves
+    // nothing to destroy with the whole array
+    template<typename Fn>
+    void drainBack( Fn fn )
+    {
+        for ( auto& kv : m_rows.back().slots() ) fn( std::move(kv) );
+        m_rows.pop_back();
+    }
+
+    template<typename Fn>
+    void forEach( size_t b, Fn fn )
+    {
+        for ( auto& kv : m_rows[b].slots() ) fn( kv );
+    }
+
+    const void* address( size_t b ) const { return &m_rows[b]; }
+
+    size_t length( size_t b ) const { return m_rows[b].slots().size(); }
+
+    size_t size() const { return m_rows.size(); }
+
+private:
+    std::vector<HashRow>    m_rows;
+    size_t                  m_allocated;
+    size_t                  m_bucketCapacity;
+};
+
+// The first N elements of each bucket live inline in the bucket array, so a
+// short chain is found without leaving the bucket. Elements beyond those
+// overflow into nodes drawn from a single arena shared by every bucket and
+// linked by index, with erased nodes kept on a free list for reuse.
+// Construction is one allocation whatever the bucket count, and K and V
+// must be default constructible (unused inline slots hold K() and V()).
+template<typename K, typename V, size_t N = 3>
+class InlineRows
+{
+private:
+    typedef uint32_t index_t;
+
+    static const index_t noNode = std::numeric_limits<index_t>::max();
+
+    struct Bucket
+    {
+        Bucket() : m_count(0), m_overflow(noNode)
+        {
+        }
+
+        index_t             m_count;
+        index_t             m_overflow;
+        std::pair<K, V>     m_inline[N];
+    };
+
+    struct Node
+    {
+        std::pair<K, V>     m_kv;
+        index_t             m_next;
+    };
+
+    index_t allocNode()
+    {
+        if ( m_free != noNode )
+        {
+            index_t n = m_free;
+            m_free = m_arena[n].m_next;
+            return n;
+        }
+
+        throwing_assert( m_arena.size() < noNode, "InlineRows overflow arena is full" );
+        m_arena.push_back( Node() );
+        return static_cast<index_t>( m_arena.size() - 1 );
+    }
+
+    void freeNode( index_t n )
+    {
+        // Drop whatever the element owns now rather than when the node is reused
+        m_arena[n].m_kv = std::pair<K, V>();
+        m_arena[n].m_next = m_free;
+        m_free = n;
+    }
+
+    // Unlink and free the head of a bucket's overflow chain
+    void popOverflow( Bucket& bucket )
+    {
+        index_t head = bucket.m_overflow;
+        bucket.m_overflow = m_arena[head].m_next;
+        freeNode( head );
+    }
+
+public:
+    InlineRows() : m_free(noNode), m_allocated(0)
+    {
+    }
+
+    // bucketCapacity is ignored: the inline capacity is fixed at N
+    InlineRows( size_t numBuckets, size_t /*bucketCapacity*/ ) : m_buckets( numBuckets ), m_free(noNode), m_allocated(numBuckets)
+    {
+    }
+
+    void allocate( size_t numBuckets, size_t /*bucketCapacity*/ )
+    {
+        m_buckets.reserve( numBuckets );
+        m_allocated = numBuckets;
+    }
+
+    bool prepare( size_t count )
+    {
+        size_t end = m_buckets.size() + std::min( count, m_allocated - m_buckets.size() );
+        m_buckets.resize( end );
+        return end == m_allocated;
+    }
+
+    template<typename Q>
+    std::pair<K, V>* find( size_t b, const Q& key )
+    {
+        Bucket& bucket = m_buckets[b];
+        size_t numInline = std::min<size_t>( bucket.m_count, N );
+        for ( size_t i = 0; i < numInline; ++i )
+        {
+            if ( bucket.m_inline[i].first == key ) return &bucket.m_inline[i];
+        }
+
+        for ( index_t n = bucket.m_overflow; n != noNode; n = m_arena[n].m_next )
+        {
+            if ( m_arena[n].m_kv.first == key ) return &m_arena[n].m_kv;
+        }
+        return NULL;
+    }
+
+    template<typename... Args>
+    std::pair<K, V>& emplace( size_t b, Args&&... args )
+    {
+        Bucket& bucket = m_buckets[b];
+        if ( bucket.m_count < N )
+        {
+            std::pair<K, V>& slot = bucket.m_inline[bucket.m_count++];
+            slot = std::pair<K, V>( std::forward<Args>(args)... );
+            return slot;
+        }
+
+        // New overflow nodes go on the front of the chain
+        index_t n = allocNode();
+        Node& node = m_arena[n];
+        node.m_kv = std::pair<K, V>( std::forward<Args>(args)... );
+        node.m_next = bucket.m_overflow;
+        bucket.m_overflow = n;
+        bucket.m_count++;
+        return node.m_kv;
+    }
+
+    template<typename Q>
+    bool erase( size_t b, const Q& key )
+    {
+        Bucket& bucket = m_buckets[b];
+        size_t numInline = std::min<size_t>( bucket.m_count, N );
+        for ( size_t i = 0; i < numInline; ++i )
+        {
+            if ( bucket.m_inline[i].first == key )
+            {
+                // Refill the hole from the overflow chain if there is one,
+                // otherwise from the last inline element.
+                if ( bucket.m_overflow != noNode )
+                {
+                    bucket.m_inline[i] = std::move( m_arena[bucket.m_overflow].m_kv );
+                    popOverflow( bucket );
+                }
+                else
+                {
+                    if ( i != numInline - 1 ) bucket.m_inline[i] = std::move( bucket.m_inline[numInline - 1] );
+                    bucket.m_inline[numInline - 1] = std::pair<K, V>();
+                }
+                bucket.m_count--;
+                return true;
+            }
+        }
+
+        for ( index_t* link = &bucket.m_overflow; *link != noNode; link = &m_arena[*link].m_next )
+        {
+            index_t n = *link;
+            if ( m_arena[n].m_kv.first == key )
+            {
+                *link = m_arena[n].m_next;
+                freeNode( n );
+                bucket.m_count--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template<typename Fn>
+    void drainBack( Fn fn )
+    {
+        Bucket& bucket = m_buckets.back();
+        size_t numInline = std::min<size_t>( bucket.m_count, N );
+        for ( size_t i = 0; i < numInline; ++i ) fn( std::move( bucket.m_inline[i] ) );
+
+        while ( bucket.m_overflow != noNode )
+        {
+            fn( std::move( m_arena[bucket.m_overflow].m_kv ) );
+            popOverflow( bucket );
+        }
+        m_buckets.pop_back();
+    }
+
+    template<typename Fn>
+    void forEach( size_t b, Fn fn )
+    {
+        Bucket& bucket = m_buckets[b];
+        size_t numInline = std::min<size_t>( bucket.m_count, N );
+        for ( size_t i = 0; i < numInline; ++i ) fn( bucket.m_inline[i] );
+        for ( index_t n = bucket.m_overflow; n != noNode; n = m_arena[n].m_next ) fn( m_arena[n].m_kv );
+    }
+
+    const void* address( size_t b ) const { return &m_buckets[b]; }
+
+    size_t length( size_t b ) const { return m_buckets[b].m_count; }
+
+    size_t size() const { return m_buckets.size(); }
+
+private:
+    std::vector<Bucket>     m_buckets;
+    std::vector<Node>       m_arena;
+    index_t                 m_free;
+    size_t                  m_allocated;
+};
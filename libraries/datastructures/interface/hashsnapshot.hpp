@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#include "checks.hpp"
+#include "controlbytes.hpp"
+
+// File format written by OpenAddressingHashTable::save and served by
+// MappedHashTable. Everything is addressed by offset from the start of the
+// file, so a mapping works wherever it lands:
+//
+//   header    this struct, padded to a section boundary
+//   ctrl      numBuckets + group width control bytes
+//   dist      numBuckets + group width probe distances
+//   cells     numBuckets std::pair<K, V>, laid out exactly as in memory
+//
+// Each section starts on a cache line. Values are in native byte order and
+// the hash function isn't recorded, so a snapshot is only good on the same
+// architecture with the same Hash and Reduction that wrote it.
+struct HashSnapshotHeader
+{
+    static const size_t sectionAlign = 64;
+    static const uint32_t currentVersion = 1;
+
+    char        m_magic[8];
+    uint32_t    m_version;
+    uint32_t    m_groupWidth;
+    uint64_t    m_keySize;
+    uint64_t    m_valueSize;
+    uint64_t    m_cellSize;
+    uint64_t    m_numBuckets;
+    uint64_t    m_size;
+    uint64_t    m_ctrlOffset;
+    uint64_t    m_distOffset;
+    uint64_t    m_cellOffset;
+    uint64_t    m_fileSize;
+
+    static uint64_t alignUp( uint64_t offset ) { return (offset + sectionAlign - 1) / sectionAlign * sectionAlign; }
+
+    static const char* magic() { return "OAHSNAP"; }
+
+    // The header for a table of numBuckets slots holding size elements
+    template<typename K, typename V>
+    static HashSnapshotHeader make( size_t numBuckets, size_t size )
+    {
+        HashSnapshotHeader h;
+        std::memset( &h, 0, sizeof(h) );
+        std::memcpy( h.m_magic, magic(), sizeof(h.m_magic) );
+        h.m_version = currentVersion;
+        h.m_groupWidth = ctrl::Group::width;
+        h.m_keySize = sizeof(K);
+        h.m_valueSize = sizeof(V);
+        h.m_cellSize = sizeof(std::pair<K, V>);
+        h.m_numBuckets = numBuckets;
+        h.m_size = size;
+
+        uint64_t mirrored = numBuckets + ctrl::Group::width;
+        h.m_ctrlOffset = alignUp( sizeof(HashSnapshotHeader) );
+        h.m_distOffset = alignUp( h.m_ctrlOffset + mirrored * sizeof(ctrl::ctrl_t) );
+        h.m_cellOffset = alignUp( h.m_distOffset + mirrored * sizeof(ctrl::dist_t) );
+        h.m_fileSize = h.m_cellOffset + numBuckets * h.m_cellSize;
+        return h;
+    }
+
+    // Throws unless this header describes a table of K and V that fits in fileSize bytes
+    template<typename K, typename V>
+    void validate( size_t fileSize ) const
+    {
+        throwing_assert( std::memcmp( m_magic, magic(), sizeof(m_magic) ) == 0, "Not a hash table snapshot" );
+        throwing_assert( m_version == currentVersion, "Unsupported hash table snapshot version" );
+        throwing_assert( m_groupWidth == ctrl::Group::width, "Hash table snapshot has a different group width" );
+        throwing_assert( m_keySize == sizeof(K) && m_valueSize == sizeof(V) && m_cellSize == sizeof(std::pair<K, V>),
+            "Hash table snapshot was written for different key or value types" );
+        throwing_assert( m_numBuckets > 0, "Hash table snapshot has no slots" );
+
+        HashSnapshotHeader expected = make<K, V>( m_numBuckets, m_size );
+        throwing_assert( m_ctrlOffset == expected.m_ctrlOffset && m_distOffset == expected.m_distOffset &&
+            m_cellOffset == expected.m_cellOffset && m_fileSize == expected.m_fileSize, "Corrupt hash table snapshot header" );
+        throwing_assert( m_fileSize <= fileSize, "Hash table snapshot is truncated" );
+    }
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+// Instrumentation for HashTable and OpenAddressingHashTable. Define
+// HASH_TABLE_STATS (for the whole program, as it changes the table layouts)
+// to give both tables a stats() method. Without it the counters and the
+// method don't exist at all.
+#ifdef HASH_TABLE_STATS
+#define HASH_STATS_ONLY( ... ) __VA_ARGS__
+#else
+#define HASH_STATS_ONLY( ... )
+#endif
+
+// Event counts kept as the table runs. Everything else in the stats is
+// worked out from the table's contents when asked for.
+struct HashStatsCounters
+{
+    HashStatsCounters() : rehashes(0), eraseShifts(0)
+    {
+    }
+
+    size_t  rehashes;
+    size_t  eraseShifts;
+};
+
+struct OpenAddressingStats
+{
+    OpenAddressingStats() : size(0), capacity(0), loadFactor(0.0f), longestCluster(0), rehashes(0), eraseShifts(0)
+    {
+    }
+
+    size_t              size;
+    size_t              capacity;
+    float               loadFactor;
+
+    // Elements by distance from their home slot: an element at distance d
+    // takes a successful lookup d + 1 slots to reach.
+    std::vector<size_t> probeLengths;
+
+    // The longest run of consecutive full slots, which bounds the worst miss
+    size_t              longestCluster;
+
+    size_t              rehashes;
+
+    // Elements shifted back a slot to close the gap left by an erase
+    size_t              eraseShifts;
+};
+
+struct HashTableStats
+{
+    HashTableStats() : size(0), bucketCount(0), loadFactor(0.0f), longestChain(0), rehashes(0)
+    {
+    }
+
+    size_t              size;
+    size_t              bucketCount;
+    float               loadFactor;
+
+    // Buckets by the number of elements chained from them
+    std::vector<size_t> chainLengths;
+
+    size_t              longestChain;
+
+    size_t              rehashes;
+};
+
+// Count value into histogram, growing it as needed
+inline void histogramAdd( std::vector<size_t>& histogram, size_t value )
+{
+    if ( histogram.size() <= value ) histogram.resize( value + 1, 0 );
+    histogram[value]++;
+}
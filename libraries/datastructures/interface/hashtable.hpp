@@ -3,108 +3,398 @@
 #include <functional>
 #include <vector>
 #include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <utility>
+#include <tuple>
 
 #include "checks.hpp"
-#include "hashtable.hpp"
+#include "hashing.hpp"
+#include "hashrows.hpp"
+#include "hashstats.hpp"
 
 
-template<typename K, typename V>
+// Hash maps keys to a size_t and Reduction (see hashing.hpp) maps that onto
+// the bucket array, which also decides the capacities the table grows through.
+// Rows (see hashrows.hpp) stores the chains: a vector per bucket by default,
+// or InlineRows to keep short chains in the bucket array itself.
+template<typename K, typename V, typename Hash = DefaultHash<K>, typename Reduction = PowerOfTwoReduction, typename Rows = VectorRows<K, V>>
 class HashTable
 {
+public:
+    typedef K       key_type;
+    typedef V       mapped_type;
+    typedef Hash    hasher;
+    
 private:
-    class HashRow
+    // Keys hashed and prefetched ahead of resolution by find_batch
+    static const size_t batchSize = 16;
+    
+    static const size_t invalidIndex = static_cast<size_t>( -1 );
+    
+    template<typename Q>
+    size_t bi( const Q& k ) { return m_reduce( m_hashFn(k) ); }
+    
+    // The bucket in the draining array that may still hold key, or
+    // invalidIndex if there is no rehash in progress or that bucket has
+    // already been moved. Buckets are moved from the back, and each one
+    // removed once it has been, so the array only holds those still to go.
+    template<typename Q>
+    size_t oldBucket( const Q& key )
     {
-    public:
-        HashRow( size_t defaultCapacity )
-        {
-            m_slots.reserve( defaultCapacity );
-        }
+        if ( m_oldBuckets.size() == 0 ) return invalidIndex;
         
-        void insert( const std::pair<K, V>& kv )
-        {
-            m_slots.push_back( kv );
-        }
+        size_t i = m_oldReduce( m_hashFn(key) );
+        return i < m_oldBuckets.size() ? i : invalidIndex;
+    }
+    
+    template<typename Q>
+    std::pair<K, V>* findSlot( const Q& key ) { return findSlot( key, m_hashFn(key) ); }
+    
+    template<typename Q>
+    std::pair<K, V>* findSlot( const Q& key, size_t hash )
+    {
+        std::pair<K, V>* slot = m_buckets.find( m_reduce(hash), key );
+        if ( slot != NULL ) return slot;
         
-        bool erase( const K& key )
+        size_t old = oldBucket( key );
+        return old == invalidIndex ? NULL : m_oldBuckets.find( old, key );
+    }
+    
+    void growIfRequired()
+    {
+        // Double the bucket count once the average chain length exceeds the maximum
+        if ( m_migrateStep != 0 ) prepareNext( maxSize() );
+        if ( m_size + 1 > m_numBuckets * m_maxLoadFactor ) rehash( Reduction::bucketCount( m_numBuckets * 2 ) );
+    }
+    
+    // Most elements the current bucket array takes before the table grows
+    size_t maxSize() const { return static_cast<size_t>( m_numBuckets * m_maxLoadFactor ); }
+    
+    // Element count from which the next bucket array is made
+    static size_t prepareFrom( size_t limit ) { return limit - limit / 4; }
+    
+    // Making a fresh bucket array is as much work as moving into it, so with
+    // incremental rehashing that is spread out too: over the last quarter of
+    // the inserts before the table reaches limit elements, enough buckets
+    // each time for the array to be ready when it is needed.
+    void prepareNext( size_t limit )
+    {
+        size_t size = static_cast<size_t>( m_size );
+        if ( m_nextNumBuckets == 0 )
         {
-            for ( auto it = m_slots.begin(); it != m_slots.end(); ++it )
-            {
-                if ( it->first == key )
-                {
-                    m_slots.erase(it);
-                    return true;
-                }
-            }
+            if ( m_oldBuckets.size() != 0 || size + 1 <= prepareFrom( limit ) ) return;
             
-            return false;
+            m_nextNumBuckets = Reduction::bucketCount( m_numBuckets * 2 );
+            m_nextBuckets.allocate( m_nextNumBuckets, m_bucketCapacity );
+            size_t inserts = limit > size ? limit - size : 1;
+            m_prepareStep = std::max( m_migrateStep, m_nextNumBuckets / inserts + 1 );
         }
+        m_nextBuckets.prepare( m_prepareStep );
+    }
+    
+    // Look the key up and, if it is absent, append an element built from
+    // args to its row. Finding the key moves nothing, so pointers the caller
+    // holds stay valid; only a miss grows or migrates, before the append.
+    template<typename... Args>
+    std::pair<V*, bool> findOrEmplace( const K& key, Args&&... args )
+    {
+        std::pair<K, V>* slot = findSlot( key );
+        if ( slot != NULL ) return std::make_pair( &slot->second, false );
+        
+        growIfRequired();
+        migrate( m_drainStep );
         
-        bool find( const K& key )
+        auto& kv = m_buckets.emplace( bi(key), std::forward<Args>(args)... );
+        m_size++;
+        return std::make_pair( &kv.second, true );
+    }
+    
+    // Smallest bucket count that keeps count elements within the maximum load factor
+    size_t bucketsFor( size_t count ) const
+    {
+        return Reduction::bucketCount( std::max<size_t>( 1, static_cast<size_t>( std::ceil( count / m_maxLoadFactor ) ) ) );
+    }
+    
+    // Move up to count rows from the draining bucket array into the current one
+    void migrate( size_t count )
+    {
+        if ( m_oldBuckets.size() == 0 ) return;
+        
+        for ( size_t moved = 0; moved < count && m_oldBuckets.size() != 0; ++moved )
         {
-            for ( size_t i = 0; i < m_slots.size(); ++i )
-            {
-                if ( m_slots[i].first == key )
-                {
-                    return true;
-                }
-            }
-            return false;
+            m_oldBuckets.drainBack( [this]( std::pair<K, V>&& kv ) { m_buckets.emplace( bi(kv.first), std::move(kv) ); } );
         }
         
-        V get( const K& key )
+        if ( m_oldBuckets.size() == 0 ) m_oldBuckets = Rows();
+    }
+    
+    void finishMigration() { migrate( m_oldBuckets.size() ); }
+    
+    // Start moving every row into a fresh bucket array, using the one
+    // prepared ahead if it is the right size. Unless incremental rehashing
+    // is enabled the move completes straight away; otherwise each insert and
+    // erase moves enough rows for the old array to be gone by the time the
+    // next one is being made, well before the next growth.
+    void rehash( size_t numBuckets )
+    {
+        throwing_assert( m_oldBuckets.size() == 0, "Previous rehash has not finished" );
+        
+        if ( m_nextNumBuckets != numBuckets )
         {
-            for ( size_t i = 0; i < m_slots.size(); ++i )
-            {
-                if ( m_slots[i].first == key )
-                {
-                    return m_slots[i].second;
-                }
-            }
-            throwing_assert( false, "Key not present in hashtable" );
+            m_nextBuckets = Rows();
+            m_nextBuckets.allocate( numBuckets, m_bucketCapacity );
         }
+        m_nextBuckets.prepare( numBuckets );
         
-    private:    
-        std::vector<std::pair<K, V>> m_slots;
-    };
+        m_oldBuckets = std::move( m_buckets );
+        m_buckets = std::move( m_nextBuckets );
+        m_nextBuckets = Rows();
+        m_nextNumBuckets = 0;
+        m_numBuckets = numBuckets;
+        m_oldReduce = m_reduce;
+        m_reduce = Reduction( numBuckets );
+        HASH_STATS_ONLY( m_counters.rehashes++; )
+        
+        size_t size = static_cast<size_t>( m_size );
+        size_t from = prepareFrom( maxSize() );
+        size_t inserts = from > size ? from - size : 1;
+        m_drainStep = std::max( m_migrateStep, m_oldBuckets.size() / inserts + 1 );
+        
+        if ( m_migrateStep == 0 ) finishMigration();
+    }
     
-private:
-    size_t bi( const K& k )
+    void rebuild( size_t numBuckets )
     {
-        return m_hashFn(k) % m_numBuckets;
+        finishMigration();
+        rehash( numBuckets );
+        finishMigration();
     }
     
 public:
-    HashTable( size_t numBuckets, size_t bucketCapacity ) : m_size(0), m_numBuckets(numBuckets), m_buckets(numBuckets, HashRow(bucketCapacity))
+    HashTable( size_t numBuckets, size_t bucketCapacity ) :
+        m_size(0),
+        m_numBuckets(Reduction::bucketCount(numBuckets)),
+        m_reduce(m_numBuckets),
+        m_bucketCapacity(bucketCapacity),
+        m_maxLoadFactor(1.0f),
+        m_migrateStep(0),
+        m_drainStep(0),
+        m_nextNumBuckets(0),
+        m_prepareStep(0),
+        m_buckets(m_numBuckets, bucketCapacity)
     {
     }
     
+    // Inserts without checking for an existing copy of the key. Use
+    // try_emplace or emplace for insert-if-absent.
     void insert( const std::pair<K, V>& kv )
     {
-        m_buckets[bi(kv.first)].insert( kv );
+        growIfRequired();
+        m_buckets.emplace( bi(kv.first), kv );
+        m_size++;
+        migrate( m_drainStep );
+    }
+    
+    void insert( std::pair<K, V>&& kv )
+    {
+        growIfRequired();
+        m_buckets.emplace( bi(kv.first), std::move(kv) );
         m_size++;
+        migrate( m_drainStep );
     }
     
-    bool erase( const K& key )
+    // Construct the value in place from args only if the key is absent.
+    // Returns the value for the key and whether it was inserted. Pointers
+    // into the table stay valid until the next insert or erase.
+    template<typename... Args>
+    std::pair<V*, bool> try_emplace( const K& key, Args&&... args )
     {
-        bool found = m_buckets[bi(key)].erase(key);
+        return findOrEmplace( key, std::piecewise_construct, std::forward_as_tuple( key ), std::forward_as_tuple( std::forward<Args>(args)... ) );
+    }
+    
+    template<typename... Args>
+    std::pair<V*, bool> try_emplace( K&& key, Args&&... args )
+    {
+        return findOrEmplace( key, std::piecewise_construct, std::forward_as_tuple( std::move(key) ), std::forward_as_tuple( std::forward<Args>(args)... ) );
+    }
+    
+    // Build the element from args, then insert it only if its key is absent
+    template<typename... Args>
+    std::pair<V*, bool> emplace( Args&&... args )
+    {
+        std::pair<K, V> kv( std::forward<Args>(args)... );
+        return findOrEmplace( kv.first, std::move(kv) );
+    }
+    
+    V& operator[]( const K& key ) { return *try_emplace( key ).first; }
+    
+    template<typename Q>
+    bool erase( const Q& key )
+    {
+        bool found = m_buckets.erase( bi(key), key );
+        if ( !found )
+        {
+            size_t old = oldBucket( key );
+            found = old != invalidIndex && m_oldBuckets.erase( old, key );
+        }
         if ( found ) m_size--;
         throwing_assert( m_size >= 0, "Number of bucket elements is negative" );
         
+        migrate( m_drainStep );
         return found;
     }
     
-    bool find( const K& key )
+    // Lookups accept any key type that Hash accepts and K compares equal to,
+    // such as a const char* against std::string keys with StringHash.
+    template<typename Q>
+    bool find( const Q& key ) { return findSlot( key ) != NULL; }
+    
+    // The value for key, or NULL if it is absent
+    template<typename Q>
+    V* findPtr( const Q& key )
+    {
+        std::pair<K, V>* slot = findSlot( key );
+        return slot == NULL ? NULL : &slot->second;
+    }
+    
+    template<typename Q>
+    V& get( const Q& key )
+    {
+        std::pair<K, V>* slot = findSlot( key );
+        throwing_assert( slot != NULL, "Key not present in hashtable" );
+        return slot->second;
+    }
+    
+    // Look up a batch of keys at once, leaving the value for each (or NULL)
+    // in out. Each chunk of keys is hashed and its rows prefetched before any
+    // key is resolved, so the cache misses for a chunk overlap rather than
+    // being taken one after another. The chains the rows point at can't be
+    // prefetched without first waiting on the row itself.
+    template<typename Q>
+    void find_batch( const std::vector<Q>& keys, std::vector<V*>& out )
+    {
+        out.resize( keys.size() );
+        
+        size_t hashes[batchSize];
+        for ( size_t start = 0; start < keys.size(); start += batchSize )
+        {
+            size_t end = std::min( start + batchSize, keys.size() );
+            for ( size_t i = start; i < end; ++i )
+            {
+                hashes[i - start] = m_hashFn( keys[i] );
+                __builtin_prefetch( m_buckets.address( m_reduce( hashes[i - start] ) ) );
+            }
+            for ( size_t i = start; i < end; ++i )
+            {
+                std::pair<K, V>* slot = findSlot( keys[i], hashes[i - start] );
+                out[i] = slot == NULL ? NULL : &slot->second;
+            }
+        }
+    }
+    
+    // As find_batch, but copying the values out. Throws if any key is absent.
+    template<typename Q>
+    void get_batch( const std::vector<Q>& keys, std::vector<V>& out )
     {
-        return m_buckets[bi(key)].find(key);
+        std::vector<V*> found;
+        find_batch( keys, found );
+        
+        out.clear();
+        out.reserve( keys.size() );
+        for ( auto value : found )
+        {
+            throwing_assert( value != NULL, "Key not present in hashtable" );
+            out.push_back( *value );
+        }
+    }
+    
+    // Call fn( key, value ) on every element, in no particular order
+    template<typename Fn>
+    void for_each( Fn fn )
+    {
+        auto visit = [&fn]( std::pair<K, V>& kv ) { fn( const_cast<const K&>( kv.first ), kv.second ); };
+        for ( size_t b = 0; b < m_buckets.size(); ++b ) m_buckets.forEach( b, visit );
+        for ( size_t b = 0; b < m_oldBuckets.size(); ++b ) m_oldBuckets.forEach( b, visit );
     }
     
     int size() { return m_size; }
     
+    size_t bucket_count() const { return m_numBuckets; }
+    
+    float load_factor() const { return static_cast<float>( m_size ) / m_numBuckets; }
+    
+    float max_load_factor() const { return m_maxLoadFactor; }
+    
+    void max_load_factor( float maxLoadFactor )
+    {
+        throwing_assert( maxLoadFactor > 0.0f, "Maximum load factor must be positive" );
+        m_maxLoadFactor = maxLoadFactor;
+        finishMigration();
+        if ( m_size > m_numBuckets * m_maxLoadFactor ) rebuild( bucketsFor( m_size ) );
+    }
+    
+    // Spread each rehash over the following inserts and erases, moving at
+    // least rowsPerOperation buckets each time, and more if that is needed
+    // to finish before the next rehash, so that no single operation pays
+    // for the whole table. The new buckets are made ahead of time over
+    // the inserts leading up to it. Zero (the default) rehashes in one go.
+    // Lookups don't move anything, so a rehash left unfinished when the
+    // inserts stop stays that way, with every miss searching both bucket
+    // arrays, until the next insert or erase.
+    void incremental_rehash( size_t rowsPerOperation )
+    {
+        m_migrateStep = rowsPerOperation;
+        m_drainStep = std::max( m_drainStep, m_migrateStep );
+        if ( m_migrateStep == 0 ) finishMigration();
+    }
+    
+    // Size the bucket array so that count elements fit without a further rehash
+    void reserve( size_t count )
+    {
+        size_t required = bucketsFor( count );
+        if ( required > m_numBuckets ) rebuild( required );
+    }
+    
+    void shrink_to_fit()
+    {
+        size_t required = bucketsFor( m_size );
+        if ( required < m_numBuckets ) rebuild( required );
+    }
+    
+#ifdef HASH_TABLE_STATS
+    // During a rehash the chains still waiting in the old bucket array are
+    // counted alongside the new ones.
+    HashTableStats stats() const
+    {
+        HashTableStats s;
+        s.size = m_size;
+        s.bucketCount = m_numBuckets;
+        s.loadFactor = load_factor();
+        s.rehashes = m_counters.rehashes;
+        for ( size_t b = 0; b < m_buckets.size(); ++b ) histogramAdd( s.chainLengths, m_buckets.length( b ) );
+        for ( size_t b = 0; b < m_oldBuckets.size(); ++b ) histogramAdd( s.chainLengths, m_oldBuckets.length( b ) );
+        s.longestChain = s.chainLengths.size() - 1;
+        return s;
+    }
+#endif
+    
 private:
     int                     m_size;
     size_t                  m_numBuckets;
-    std::vector<HashRow>    m_buckets;
-    std::hash<K>            m_hashFn;
+    Reduction               m_reduce;
+    Reduction               m_oldReduce;
+    size_t                  m_bucketCapacity;
+    float                   m_maxLoadFactor;
+    size_t                  m_migrateStep;
+    size_t                  m_drainStep;
+    size_t                  m_nextNumBuckets;
+    size_t                  m_prepareStep;
+    Rows                    m_buckets;
+    Rows                    m_oldBuckets;
+    Rows                    m_nextBuckets;
+    Hash                    m_hashFn;
+    HASH_STATS_ONLY( HashStatsCounters m_counters; )
 };
 
 
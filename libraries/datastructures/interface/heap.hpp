@@ -1,117 +1,159 @@
 #pragma once
 
 #include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+#include <cstddef>
 
-template<typename T, typename Comparison=std::less<T>>
+#include "checks.hpp"
+
+// Define HEAP_CHECKED to have every heap check its whole ordering after each
+// change. That makes every operation O(n), so it is for tests only.
+#ifdef HEAP_CHECKED
+#define HEAP_CHECKED_ONLY( ... ) __VA_ARGS__
+#else
+#define HEAP_CHECKED_ONLY( ... )
+#endif
+
+// A min-heap (by Comparison) in which each node has Arity children. The
+// children of a node sit next to each other, so a 4-ary heap reads all four
+// from a line or two of cache where a binary heap would go down twice as
+// many levels, each a likely miss once the heap is larger than the cache.
+// Pushes are a little cheaper again, with fewer levels to rise through.
+//
+// Sifting moves elements along into a hole left for the one being placed
+// rather than swapping, so each level costs one move instead of three.
+template<typename T, typename Comparison=std::less<T>, size_t Arity=4>
 class heap
 {
-private:
-    typedef size_t fromOneIndex_t;
-    
+    static_assert( Arity >= 2, "A heap needs at least two children per node" );
+
 public:
+    // For comparisons that carry state, such as lambdas
+    explicit heap( const Comparison& cmp = Comparison() ) : m_cmp(cmp)
+    {
+    }
+
     void push( const T& val )
     {
         m_storage.push_back( val );
-        
-        bubble_up(m_storage.size());
+        sift_up( m_storage.size() - 1 );
+        HEAP_CHECKED_ONLY( validate(); )
+    }
+
+    void push( T&& val )
+    {
+        m_storage.push_back( std::move( val ) );
+        sift_up( m_storage.size() - 1 );
+        HEAP_CHECKED_ONLY( validate(); )
     }
-    
+
+    // The least element, which pop would return
+    const T& top()
+    {
+        return m_storage.front();
+    }
+
+    // Pop the least element and push val, in one pass down the heap
+    void replaceTop( T val )
+    {
+        throwing_assert( !empty(), "replaceTop on an empty heap" );
+        sift_down( 0, std::move( val ) );
+        HEAP_CHECKED_ONLY( validate(); )
+    }
+
     T pop()
     {
-        auto next = m_storage.front();
-        m_storage.front() = m_storage.back();
+        T next = std::move( m_storage.front() );
+        T last = std::move( m_storage.back() );
         m_storage.pop_back();
-        
+
         if ( !empty() )
         {
-            bubble_down(1);
+            sift_down( 0, std::move( last ) );
         }
-        
+
+        HEAP_CHECKED_ONLY( validate(); )
         return next;
     }
-    
+
     bool empty()
     {
         return m_storage.empty();
     }
-    
+
     size_t size()
     {
         return m_storage.size();
     }
 
+    void reserve( size_t n )
+    {
+        m_storage.reserve( n );
+    }
+
 private:
-    T& get( fromOneIndex_t index ) { return m_storage[index-1]; }
-    
+    static size_t parent( size_t index ) { return (index - 1) / Arity; }
+    static size_t firstChild( size_t index ) { return index * Arity + 1; }
+
     void validate()
     {
-        for ( fromOneIndex_t i = 2; i <= size(); ++i )
+        for ( size_t i = 1; i < size(); ++i )
         {
-            CHECK( !m_cmp( get(i), get(i/2) ) );
+            CHECK( !m_cmp( m_storage[i], m_storage[parent( i )] ) );
         }
     }
-    
-    // Note: both bubble_up and bubble_down accept indices starting from 1
-    // in order to simplify the maths. But they require the
-    // 1 to be subtracted before finally doing a vector access
-    void bubble_up( fromOneIndex_t childIndex )
+
+    // Move the element at index up until its parent is no greater
+    void sift_up( size_t index )
     {
-        while ( childIndex != 1 )
+        if ( index == 0 ) return;
+
+        T value = std::move( m_storage[index] );
+        while ( index != 0 && m_cmp( value, m_storage[parent( index )] ) )
         {
-            auto parentIndex = childIndex / 2;
-            T& parent = get(parentIndex);
-            T& child = get(childIndex);
-            
-            if ( m_cmp( child, parent ) )
-            {
-                std::swap( child, parent );
-                childIndex = parentIndex;
-            }
-            else break;
+            m_storage[index] = std::move( m_storage[parent( index )] );
+            index = parent( index );
         }
+        m_storage[index] = std::move( value );
     }
-    
-    void bubble_down( fromOneIndex_t parentIndex )
+
+    // Place value in the hole at index, moving the least child up into the
+    // hole for as long as it is less than value
+    void sift_down( size_t index, T value )
     {
-        while ( parentIndex < size() )
+        size_t n = size();
+        while ( true )
         {
-            auto childIndex1 = parentIndex * 2;
-            
-            if ( childIndex1 <= size() )
+            size_t first = firstChild( index );
+            if ( first >= n ) break;
+
+            // A full set of children is a fixed count the compiler can unroll
+            size_t least = first;
+            if ( first + Arity <= n )
+            {
+                for ( size_t c = 1; c < Arity; ++c )
+                {
+                    if ( m_cmp( m_storage[first + c], m_storage[least] ) ) least = first + c;
+                }
+            }
+            else
             {
-                auto childIndex2 = childIndex1 + 1;
-                
-                // Quick hack to deal with there being only a child1 remaining
-                if ( childIndex2 > size() ) childIndex2 = childIndex1;
-                
-                T& parent = get(parentIndex);
-                
-                T& child1 = get(childIndex1);
-                T& child2 = get(childIndex2);
-                
-                typedef std::pair<fromOneIndex_t, T&> cmp_t;
-                
-                cmp_t cmp = m_cmp( child1, child2 ) ?
-                    cmp_t( childIndex1, child1 ) :
-                    cmp_t( childIndex2, child2 );
-                
-                
-                if ( m_cmp( cmp.second, parent ) )
+                for ( size_t c = first + 1; c < n; ++c )
                 {
-                    std::swap( cmp.second, parent );
-                    parentIndex = cmp.first;
+                    if ( m_cmp( m_storage[c], m_storage[least] ) ) least = c;
                 }
-                else break;
             }
-            else break;
+
+            if ( !m_cmp( m_storage[least], value ) ) break;
+            m_storage[index] = std::move( m_storage[least] );
+            index = least;
         }
-        
-        validate();
+        m_storage[index] = std::move( value );
     }
-    
+
 private:
     Comparison      m_cmp;
     std::vector<T>  m_storage;
 };
-
-
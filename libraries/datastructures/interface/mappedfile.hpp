@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+// A whole file mapped read-only into memory. The pages are shared with the
+// page cache, so every process mapping the same file shares one copy.
+class MappedFile
+{
+public:
+    explicit MappedFile( const std::string& path );
+    ~MappedFile();
+    
+    MappedFile( const MappedFile& ) = delete;
+    MappedFile& operator=( const MappedFile& ) = delete;
+    
+    const char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    
+private:
+    const char*     m_data;
+    size_t          m_size;
+};
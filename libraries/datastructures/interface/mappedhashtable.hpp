@@ -0,0 +1,85 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <cstddef>
+
+#include "checks.hpp"
+#include "hashing.hpp"
+#include "hashsnapshot.hpp"
+#include "mappedfile.hpp"
+#include "openaddressinghashtable.hpp"
+
+// Read-only view of a snapshot written by OpenAddressingHashTable::save.
+// Lookups probe the mapped file directly, so opening one costs a header check
+// rather than a rebuild, and pages are only read in as lookups touch them.
+// Hash and Reduction must match those of the table that was saved.
+template<typename K, typename V, typename Hash = DefaultHash<K>, typename Reduction = PowerOfTwoReduction>
+class MappedHashTable
+{
+private:
+    typedef SlotLayout<std::pair<K, V>, Reduction> layout_t;
+    
+    static const HashSnapshotHeader& headerOf( const MappedFile& file )
+    {
+        throwing_assert( file.size() >= sizeof(HashSnapshotHeader), "Hash table snapshot is truncated" );
+        const HashSnapshotHeader& header = *reinterpret_cast<const HashSnapshotHeader*>( file.data() );
+        header.validate<K, V>( file.size() );
+        return header;
+    }
+    
+    static layout_t layoutOf( const MappedFile& file )
+    {
+        const HashSnapshotHeader& header = headerOf( file );
+        const char* base = file.data();
+        return layout_t(
+            reinterpret_cast<const ctrl::ctrl_t*>( base + header.m_ctrlOffset ),
+            reinterpret_cast<const ctrl::dist_t*>( base + header.m_distOffset ),
+            reinterpret_cast<const std::pair<K, V>*>( base + header.m_cellOffset ),
+            header.m_numBuckets,
+            Reduction( header.m_numBuckets ) );
+    }
+    
+    template<typename Q>
+    const std::pair<K, V>* findCell( const Q& k ) const { return m_layout.find( k, m_hashFn(k) ); }
+    
+public:
+    explicit MappedHashTable( const std::string& path ) :
+        m_file( new MappedFile( path ) ),
+        m_layout( layoutOf( *m_file ) ),
+        m_size( headerOf( *m_file ).m_size ),
+        m_capacity( headerOf( *m_file ).m_numBuckets )
+    {
+    }
+    
+    size_t size() const { return m_size; }
+    
+    size_t capacity() const { return m_capacity; }
+    
+    template<typename Q>
+    bool find( const Q& k ) const { return findCell(k) != NULL; }
+    
+    // The value for k, or NULL if it is absent
+    template<typename Q>
+    const V* findPtr( const Q& k ) const
+    {
+        auto cell = findCell(k);
+        return cell == NULL ? NULL : &cell->second;
+    }
+    
+    template<typename Q>
+    const V& get( const Q& k ) const
+    {
+        auto cell = findCell(k);
+        throwing_assert( cell != NULL, "Key not found in get" );
+        return cell->second;
+    }
+    
+private:
+    std::unique_ptr<MappedFile>     m_file;
+    layout_t                        m_layout;
+    size_t                          m_size;
+    size_t                          m_capacity;
+    Hash                            m_hashFn;
+};
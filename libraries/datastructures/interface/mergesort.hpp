@@ -1,75 +1,290 @@
 #pragma once
 
 #include <vector>
+#include <iterator>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+#include "comparators.hpp"
+#include "sortingnetwork.hpp"
+#include "threadpool.hpp"
+
+// Below this many elements the parallel sort just sorts on the calling thread
+const size_t parallelMergeSortThreshold = 1 << 14;
+
+// Move-merge the sorted runs [a, aEnd) and [b, bEnd) into out. Equal
+// elements are taken from a first, which keeps the sort stable.
+template<typename In, typename Out, typename Cmp>
+Out mergeRuns( In a, In aEnd, In b, In bEnd, Out out, Cmp cmp )
+{
+    while ( a != aEnd && b != bEnd )
+    {
+        if ( cmp( *b, *a ) ) *out++ = std::move( *b++ );
+        else *out++ = std::move( *a++ );
+    }
+    out = std::move( a, aEnd, out );
+    return std::move( b, bEnd, out );
+}
+
+// One bottom-up pass: merge each pair of adjacent runs of length span in
+// from into to.
+template<typename In, typename Out, typename Cmp>
+void mergePass( In from, Out to, size_t n, size_t span, Cmp cmp )
+{
+    for ( size_t s = 0; s < n; s += span * 2 )
+    {
+        size_t mid = std::min( s + span, n );
+        size_t end = std::min( s + span * 2, n );
+        mergeRuns( from + s, from + mid, from + mid, from + end, to + s, cmp );
+    }
+}
+
+// Sort blocks of sortingNetworkMaxSize elements in place with a sorting
+// network, where there is one for the elements. Returns the length of the
+// sorted runs the merge passes can start from.
+template<typename It, typename Cmp>
+size_t presortBlocks( It data, size_t n, Cmp, std::true_type )
+{
+    if ( n == 0 ) return 1;
+
+    for ( size_t s = 0; s < n; s += sortingNetworkMaxSize )
+    {
+        sortingNetworkSort( &data[s], std::min( sortingNetworkMaxSize, n - s ) );
+    }
+    return sortingNetworkMaxSize;
+}
+
+template<typename It, typename Cmp>
+size_t presortBlocks( It, size_t, Cmp, std::false_type )
+{
+    return 1;
+}
+
+// The networks may swap equal elements, which for integers can't be seen but
+// for floating point can: -0.0 and 0.0 compare equal. So a stable sort only
+// presorts integers.
+template<typename It, typename Cmp>
+struct MergeSortUsesSortingNetwork : std::integral_constant<bool,
+    UsesSortingNetwork<It, Cmp>::value && std::is_integral<typename std::iterator_traits<It>::value_type>::value>
+{
+};
+
+// Bottom-up merge sort of the n elements at data, with the n elements at buf
+// (any values) as scratch. Each pass moves everything across, so the
+// buffers swap roles rather than being copied back. Returns whether the
+// sorted elements ended up in buf.
+template<typename It, typename BufIt, typename Cmp>
+bool mergeSortRuns( It data, BufIt buf, size_t n, Cmp cmp )
+{
+    bool inBuf = false;
+    for ( size_t span = presortBlocks( data, n, cmp, MergeSortUsesSortingNetwork<It, Cmp>() ); span < n; span *= 2 )
+    {
+        if ( inBuf ) mergePass( buf, data, n, span, cmp );
+        else mergePass( data, buf, n, span, cmp );
+        inBuf = !inBuf;
+    }
+    return inBuf;
+}
+
+// As mergeSortRuns, but building buf (which starts empty) by move
+// constructing the first pass into it, so elements need not be default
+// constructible.
+template<typename It, typename T, typename Cmp>
+bool mergeSortInto( It data, std::vector<T>& buf, size_t n, Cmp cmp )
+{
+    size_t span = presortBlocks( data, n, cmp, MergeSortUsesSortingNetwork<It, Cmp>() );
+    if ( span >= n ) return false;
+
+    buf.reserve( n );
+    for ( size_t s = 0; s < n; s += span * 2 )
+    {
+        size_t mid = std::min( s + span, n );
+        size_t end = std::min( s + span * 2, n );
+        mergeRuns( data + s, data + mid, data + mid, data + end, std::back_inserter( buf ), cmp );
+    }
+
+    bool inBuf = true;
+    for ( span *= 2; span < n; span *= 2 )
+    {
+        if ( inBuf ) mergePass( buf.begin(), data, n, span, cmp );
+        else mergePass( data, buf.begin(), n, span, cmp );
+        inBuf = !inBuf;
+    }
+    return inBuf;
+}
+
+// Stable sort of any random access range
+template<typename It, typename Cmp>
+void mergeSort( It first, It last, Cmp cmp )
+{
+    std::vector<typename std::iterator_traits<It>::value_type> buf;
+    if ( mergeSortInto( first, buf, last - first, cmp ) ) std::move( buf.begin(), buf.end(), first );
+}
+
+template<typename It>
+void mergeSort( It first, It last ) { mergeSort( first, last, Less() ); }
+
+// A whole vector can just trade places with the buffer at the end
+template<typename T, typename Cmp>
+void mergeSort( std::vector<T>& data, Cmp cmp )
+{
+    std::vector<T> buf;
+    if ( mergeSortInto( data.begin(), buf, data.size(), cmp ) ) data.swap( buf );
+}
 
 template<typename T>
-void mergeSort( std::vector<T>& data )
+void mergeSort( std::vector<T>& data ) { mergeSort( data, Less() ); }
+
+// Merge path: of the first diagonal elements the merge of a and b would
+// output, how many come from a. Lets one merge be split into independent
+// pieces that each start from a known position in both inputs.
+template<typename It, typename Cmp>
+size_t mergePathSplit( It a, size_t na, It b, size_t nb, size_t diagonal, Cmp cmp )
 {
-    int length = data.size();
-    std::vector<T> buf( data.begin(), data.end() );
-    
-    auto iteration = [length]( int span, const std::vector<T>& from, std::vector<T>& to ) -> void
+    size_t lo = diagonal > nb ? diagonal - nb : 0;
+    size_t hi = std::min( diagonal, na );
+    while ( lo < hi )
     {
-        auto interleave = [length, span, &from, &to]( int s ) -> void
+        size_t mid = lo + (hi - lo) / 2;
+
+        // Does a[mid] come out after b[diagonal - mid - 1]?
+        if ( cmp( b[diagonal - mid - 1], a[mid] ) ) hi = mid;
+        else lo = mid + 1;
+    }
+    return lo;
+}
+
+// Merge the runs between bounds pairwise from `from` into `to`, cutting
+// each merge along merge paths into pieces spread across the pool. Returns
+// the bounds of the merged runs.
+template<typename In, typename Out, typename Cmp>
+std::vector<size_t> parallelMergePass( In from, Out to, const std::vector<size_t>& bounds, ThreadPool& pool, Cmp cmp )
+{
+    struct Piece
+    {
+        size_t  start;
+        size_t  mid;
+        size_t  end;
+        size_t  outBegin;
+        size_t  outEnd;
+    };
+
+    // Aim for a few pieces per thread, to even out the load
+    size_t n = bounds.back();
+    size_t piecesPerPass = pool.size() * 4;
+
+    std::vector<Piece> pieces;
+    std::vector<size_t> merged( 1, 0 );
+    for ( size_t r = 0; r + 1 < bounds.size(); r += 2 )
+    {
+        // A run without a partner is merged with nothing, i.e. moved across
+        size_t start = bounds[r];
+        size_t mid = bounds[r + 1];
+        size_t end = r + 2 < bounds.size() ? bounds[r + 2] : mid;
+
+        size_t numPieces = std::max<size_t>( 1, ((end - start) * piecesPerPass + n - 1) / n );
+        for ( size_t p = 0; p < numPieces; ++p )
         {
-            auto s1 = s;
-            auto e1 = s + span;
-            auto s2 = e1;
-            auto e2 = std::min( s1 + span*2, length );
-            auto out = s;
-            
-            while ( out < e2 )
-            {
-                // Left series exhausted
-                if ( s1 >= e1 )
-                {
-                    to[out] = from[s2];
-                    s2 += 1;
-                }
-                // Right series exhausted
-                else if ( s2 >= e2 )
-                {
-                    to[out] = from[s1];
-                    s1 += 1;
-                }
-                else
-                {
-                    auto l = from[s1];
-                    auto r = from[s2];
-                    if ( l < r )
-                    {
-                        to[out] = l;
-                        s1 += 1;
-                    }
-                    else
-                    {
-                        to[out] = r;
-                        s2 += 1;
-                    }
-                }
-                out += 1;
-            }
-        };
-        for ( int i = 0; i < length; i += (span*2) )
+            Piece piece = { start, mid, end, start + (end - start) * p / numPieces, start + (end - start) * (p + 1) / numPieces };
+            pieces.push_back( piece );
+        }
+        merged.push_back( end );
+    }
+
+    // Find where every piece starts in its inputs before any piece moves
+    // elements out of them, since the search reads outside the piece's own
+    // part of the inputs
+    std::vector<size_t> splits( pieces.size() );
+    pool.run( pieces.size(), [&]( size_t i )
+    {
+        const Piece& p = pieces[i];
+        splits[i] = mergePathSplit( from + p.start, p.mid - p.start, from + p.mid, p.end - p.mid, p.outBegin - p.start, cmp );
+    } );
+
+    pool.run( pieces.size(), [&]( size_t i )
+    {
+        const Piece& p = pieces[i];
+        In a = from + p.start;
+        In b = from + p.mid;
+
+        // The next piece of the same merge starts where this one ends
+        size_t d0 = p.outBegin - p.start;
+        size_t d1 = p.outEnd - p.start;
+        size_t a0 = splits[i];
+        size_t a1 = p.outEnd == p.end ? p.mid - p.start : splits[i + 1];
+        mergeRuns( a + a0, a + a1, b + (d0 - a0), b + (d1 - a1), to + p.outBegin, cmp );
+    } );
+
+    return merged;
+}
+
+// Sort each chunk on its own thread and merge the sorted runs pairwise with
+// parallelMergePass until one remains. Returns whether it ended up in buf.
+template<typename It, typename T, typename Cmp>
+bool parallelMergeSortRuns( It data, std::vector<T>& buf, size_t n, ThreadPool& pool, Cmp cmp )
+{
+    size_t numThreads = pool.size();
+
+    // Runs are [bounds[i], bounds[i + 1])
+    std::vector<size_t> bounds;
+    for ( size_t c = 0; c <= numThreads; ++c ) bounds.push_back( n * c / numThreads );
+
+    pool.run( numThreads, [&]( size_t c )
+    {
+        size_t start = bounds[c];
+        size_t length = bounds[c + 1] - start;
+        if ( mergeSortRuns( data + start, buf.begin() + start, length, cmp ) )
         {
-            interleave( i );
+            std::move( buf.begin() + start, buf.begin() + start + length, data + start );
         }
-    };
-    
-    auto a = &data;
-    auto b = &buf;
-    for ( int span = 1; span < length; span *= 2 )
+    } );
+
+    bool inBuf = false;
+    while ( bounds.size() > 2 )
+    {
+        if ( inBuf ) bounds = parallelMergePass( buf.begin(), data, bounds, pool, cmp );
+        else bounds = parallelMergePass( data, buf.begin(), bounds, pool, cmp );
+        inBuf = !inBuf;
+    }
+    return inBuf;
+}
+
+// Parallel stable sort on pool. Each thread first sorts its own chunk, then
+// pairs of sorted runs are merged until one remains. A merge is cut along
+// merge paths into several pieces, so every round keeps all the threads busy
+// rather than only as many as there are pairs left. Elements must be default
+// constructible, for the scratch buffer.
+template<typename It, typename Cmp>
+void mergeSort( It first, It last, ThreadPool& pool, Cmp cmp )
+{
+    size_t n = last - first;
+    if ( pool.size() == 1 || n < parallelMergeSortThreshold )
     {
-        iteration( span, *a, *b );
-        auto tmp = b;
-        b = a;
-        a = tmp;
+        mergeSort( first, last, cmp );
+        return;
     }
 
-    if ( a != &data )
+    std::vector<typename std::iterator_traits<It>::value_type> buf( n );
+    if ( parallelMergeSortRuns( first, buf, n, pool, cmp ) ) std::move( buf.begin(), buf.end(), first );
+}
+
+template<typename It>
+void mergeSort( It first, It last, ThreadPool& pool ) { mergeSort( first, last, pool, Less() ); }
+
+template<typename T, typename Cmp>
+void mergeSort( std::vector<T>& data, ThreadPool& pool, Cmp cmp )
+{
+    size_t n = data.size();
+    if ( pool.size() == 1 || n < parallelMergeSortThreshold )
     {
-        data = buf;
-    //std::swap( data, buf );
+        mergeSort( data, cmp );
+        return;
     }
+
+    std::vector<T> buf( n );
+    if ( parallelMergeSortRuns( data.begin(), buf, n, pool, cmp ) ) data.swap( buf );
 }
 
+template<typename T>
+void mergeSort( std::vector<T>& data, ThreadPool& pool ) { mergeSort( data, pool, Less() ); }
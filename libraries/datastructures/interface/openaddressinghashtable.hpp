@@ -3,99 +3,786 @@
 #include <functional>
 #include <vector>
 #include <limits>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <utility>
+#include <tuple>
+#include <string>
+#include <fstream>
+#include <type_traits>
 
-template<typename K, typename V>
+#include "checks.hpp"
+#include "controlbytes.hpp"
+#include "hashing.hpp"
+#include "hashsnapshot.hpp"
+#include "hashstats.hpp"
+
+// Read-only Robin Hood probing over one generation of slots: a control
+// byte and probe distance per slot, each array mirrored for a group past its
+// end, alongside the cells. Owns nothing, so it runs just as well over the
+// table's own arrays as over a mapped snapshot (see mappedhashtable.hpp).
+template<typename Cell, typename Reduction>
+class SlotLayout
+{
+private:
+    typedef ctrl::Group group_t;
+
+public:
+    // Where a probe for a key ended: the slot holding it, or otherwise the
+    // slot it belongs in and its distance from home there.
+    struct Probe
+    {
+        size_t          index;
+        ctrl::dist_t    dist;
+        bool            found;
+    };
+
+    SlotLayout( const ctrl::ctrl_t* ctrl, const ctrl::dist_t* dist, const Cell* cells, size_t numBuckets, const Reduction& reduce ) :
+        m_ctrl(ctrl),
+        m_dist(dist),
+        m_cells(cells),
+        m_numBuckets(numBuckets),
+        m_reduce(reduce)
+    {
+    }
+
+    // Probe a group at a time. Keys are only compared on a tag hit, and
+    // the first slot that is empty or holds an element closer to its own
+    // home than we are to ours means the key is not present. That slot is
+    // also exactly where a Robin Hood insert of the key would land. With
+    // matchKey false this just finds that placement.
+    template<typename Q>
+    Probe probe( const Q& k, size_t hash, bool matchKey ) const
+    {
+        ctrl::ctrl_t h2 = ctrl::tag( hash );
+        size_t i = m_reduce( hash );
+
+        for ( size_t offset = 0; offset < m_numBuckets; offset += group_t::width )
+        {
+            group_t g( &m_ctrl[i] );
+            for ( auto m = matchKey ? g.match( h2 ) : ctrl::BitMask(0); m.any(); m.next() )
+            {
+                size_t index = i;
+                inc( index, m.lowest() );
+                if ( m_cells[index].first == k ) return Probe { index, 0, true };
+            }
+
+            auto stop = ctrl::BitMask( g.matchEmpty().bits() | ctrl::DistanceGroup( &m_dist[i] ).matchBelow( offset ).bits() );
+            if ( stop.any() )
+            {
+                size_t lane = stop.lowest();
+                size_t index = i;
+                inc( index, lane );
+                return Probe { index, static_cast<ctrl::dist_t>( offset + lane ), false };
+            }
+
+            inc( i, group_t::width );
+        }
+        throwing_assert( false, "Probe ran off the end of a full OpenAddressingHashTable" );
+        return Probe { std::numeric_limits<size_t>::max(), 0, false };
+    }
+
+    // The cell holding k, or NULL if it is absent
+    template<typename Q>
+    const Cell* find( const Q& k, size_t hash ) const
+    {
+        Probe p = probe( k, hash, true );
+        return p.found ? &m_cells[p.index] : NULL;
+    }
+
+    // Start pulling in the lines a probe for hash will touch first. The
+    // distances are only read on a miss, and prefetching them as well
+    // just crowds out the others.
+    void prefetch( size_t hash ) const
+    {
+        size_t i = m_reduce( hash );
+        __builtin_prefetch( &m_ctrl[i] );
+        __builtin_prefetch( &m_cells[i] );
+    }
+
+private:
+    // Steps never exceed a group, which never exceeds the capacity, so
+    // wrapping needs no division
+    void inc( size_t& index, size_t by ) const
+    {
+        index += by;
+        if ( index >= m_numBuckets ) index -= m_numBuckets;
+    }
+
+private:
+    const ctrl::ctrl_t*     m_ctrl;
+    const ctrl::dist_t*     m_dist;
+    const Cell*             m_cells;
+    size_t                  m_numBuckets;
+    Reduction               m_reduce;
+};
+
+// Hash maps keys to a size_t and Reduction (see hashing.hpp) maps that onto
+// the slot array, which also decides the capacities the table grows through.
+template<typename K, typename V, typename Hash = DefaultHash<K>, typename Reduction = PowerOfTwoReduction>
 class OpenAddressingHashTable
 {
+public:
+    typedef K       key_type;
+    typedef V       mapped_type;
+    typedef Hash    hasher;
+
+private:
+    typedef ctrl::Group group_t;
+
+    static const size_t invalidIndex = std::numeric_limits<size_t>::max();
+
+    // Keys hashed and prefetched ahead of resolution by find_batch
+    static const size_t batchSize = 16;
+
+    // One generation of slots. The table normally has just one of these, but
+    // an incremental rehash keeps the previous generation alive while it drains.
+    //
+    // Slots are placed Robin Hood style: each records how far it sits from its
+    // home bucket, and an insert takes over any slot whose occupant is closer
+    // to home than the element being placed. That keeps probe lengths even
+    // and lets a miss stop early, and erase shifts the rest of the run back
+    // rather than leaving tombstones.
+    class SlotArray
+    {
+    public:
+        SlotArray() : m_numBuckets(0), m_size(0), m_reduce(1)
+        {
+        }
+
+        SlotArray( size_t numBuckets ) : SlotArray()
+        {
+            allocate( numBuckets );
+            prepare( numBuckets );
+        }
+
+        // Reserve the arrays for numBuckets slots without filling any in.
+        // prepare then fills them in, as many at a time as the caller likes,
+        // and the generation can't be used until it has finished.
+        void allocate( size_t numBuckets )
+        {
+            m_numBuckets = numBuckets;
+            m_reduce = Reduction( numBuckets );
+            m_cellData.reserve( numBuckets );
+            m_ctrl.reserve( numBuckets + group_t::width );
+            m_dist.reserve( numBuckets + group_t::width );
+        }
+
+        // Fill in up to count more empty slots, then the mirrored group once
+        // they are all there. Returns whether the generation is ready.
+        bool prepare( size_t count )
+        {
+            size_t end = m_cellData.size() + std::min( count, m_numBuckets - m_cellData.size() );
+            m_cellData.resize( end );
+            m_ctrl.resize( end, ctrl::kEmpty );
+            m_dist.resize( end, 0 );
+            if ( end < m_numBuckets ) return false;
+
+            m_ctrl.resize( m_numBuckets + group_t::width, ctrl::kEmpty );
+            m_dist.resize( m_numBuckets + group_t::width, 0 );
+            return true;
+        }
+
+        size_t numBuckets() const { return m_numBuckets; }
+        size_t size() const { return m_size; }
+
+        bool isFull( size_t i ) const { return ctrl::isFull( m_ctrl[i] ); }
+        std::pair<K, V>& cell( size_t i ) { return m_cellData[i]; }
+        const std::pair<K, V>& cell( size_t i ) const { return m_cellData[i]; }
+
+        typedef SlotLayout<std::pair<K, V>, Reduction> layout_t;
+        typedef typename layout_t::Probe Probe;
+
+        // The arrays as a layout, for probing
+        layout_t layout() const
+        {
+            return layout_t( m_ctrl.data(), m_dist.data(), m_cellData.data(), m_numBuckets, m_reduce );
+        }
+
+        template<typename Q>
+        Probe probe( const Q& k, size_t hash, bool matchKey ) const { return layout().probe( k, hash, matchKey ); }
+
+        void prefetch( size_t hash ) const { layout().prefetch( hash ); }
+
+        template<typename Q>
+        size_t findIndex( const Q& k, size_t hash ) const
+        {
+            Probe p = probe( k, hash, true );
+            return p.found ? p.index : invalidIndex;
+        }
+
+        // Insert at the placement from a failed probe, carrying any displaced
+        // elements onwards: each one takes over the first slot whose occupant
+        // is closer to home than it is. Returns where v ended up.
+        template<typename P>
+        size_t insertAt( const Probe& p, size_t hash, P&& v )
+        {
+            size_t i = p.index;
+            ctrl::dist_t dist = p.dist;
+            ctrl::ctrl_t h2 = ctrl::tag( hash );
+
+            if ( !isFull( i ) )
+            {
+                m_cellData[i] = std::forward<P>( v );
+                setSlot( i, h2, dist );
+                m_size += 1;
+                return i;
+            }
+
+            std::pair<K, V> inHand( std::move( m_cellData[i] ) );
+            ctrl::ctrl_t inHandH2 = m_ctrl[i];
+            ctrl::dist_t inHandDist = m_dist[i];
+            m_cellData[i] = std::forward<P>( v );
+            setSlot( i, h2, dist );
+            size_t placed = i;
+
+            inc( i );
+            inHandDist += 1;
+            while ( isFull( i ) )
+            {
+                // Take from the rich: swap in and carry the displaced element onwards
+                if ( m_dist[i] < inHandDist )
+                {
+                    std::swap( inHand, m_cellData[i] );
+                    ctrl::ctrl_t displacedH2 = m_ctrl[i];
+                    ctrl::dist_t displacedDist = m_dist[i];
+                    setSlot( i, inHandH2, inHandDist );
+                    inHandH2 = displacedH2;
+                    inHandDist = displacedDist;
+                }
+                inc( i );
+                inHandDist += 1;
+                throwing_assert( inHandDist != ctrl::kMaxDist, "Probe distance overflow in OpenAddressingHashTable" );
+            }
+            m_cellData[i] = std::move( inHand );
+            setSlot( i, inHandH2, inHandDist );
+            m_size += 1;
+            return placed;
+        }
+
+        // Insert without checking for an existing copy of the key
+        template<typename P>
+        size_t insert( P&& v, size_t hash )
+        {
+            return insertAt( probe( v.first, hash, false ), hash, std::forward<P>( v ) );
+        }
+
+        // Shift the rest of the run back one slot until reaching an element
+        // already in its home bucket (or an empty slot). Returns the number
+        // of elements shifted.
+        size_t eraseAt( size_t i )
+        {
+            size_t shifted = 0;
+            size_t next = i;
+            inc( next );
+            while ( isFull( next ) && m_dist[next] > 0 )
+            {
+                m_cellData[i] = std::move( m_cellData[next] );
+                setSlot( i, m_ctrl[next], m_dist[next] - 1 );
+                i = next;
+                inc( next );
+                shifted++;
+            }
+            m_cellData[i] = std::make_pair( K(), V() );
+            setSlot( i, ctrl::kEmpty, 0 );
+            m_size--;
+            return shifted;
+        }
+
+#ifdef HASH_TABLE_STATS
+        // Add this generation's probe lengths and clusters to stats
+        void addStats( OpenAddressingStats& stats ) const
+        {
+            size_t run = 0;
+            size_t leadingRun = 0;
+            bool seenEmpty = false;
+            for ( size_t i = 0; i < m_numBuckets; ++i )
+            {
+                if ( isFull( i ) )
+                {
+                    histogramAdd( stats.probeLengths, m_dist[i] );
+                    run++;
+                    continue;
+                }
+
+                if ( !seenEmpty ) leadingRun = run;
+                seenEmpty = true;
+                stats.longestCluster = std::max( stats.longestCluster, run );
+                run = 0;
+            }
+
+            // The last run wraps round into the first
+            stats.longestCluster = std::max( stats.longestCluster, seenEmpty ? run + leadingRun : run );
+        }
+#endif
+
+        // Write the arrays out at the offsets header gives, zero filling the gaps
+        void write( std::ostream& out, const HashSnapshotHeader& header ) const
+        {
+            uint64_t pos = sizeof(header);
+            writeAt( out, pos, header.m_ctrlOffset, m_ctrl.data(), m_ctrl.size() * sizeof(ctrl::ctrl_t) );
+            writeAt( out, pos, header.m_distOffset, m_dist.data(), m_dist.size() * sizeof(ctrl::dist_t) );
+            writeAt( out, pos, header.m_cellOffset, m_cellData.data(), m_cellData.size() * sizeof(std::pair<K, V>) );
+        }
+
+    private:
+        static void writeAt( std::ostream& out, uint64_t& pos, uint64_t offset, const void* data, size_t bytes )
+        {
+            static const char zeros[HashSnapshotHeader::sectionAlign] = {};
+            out.write( zeros, offset - pos );
+            out.write( static_cast<const char*>( data ), bytes );
+            pos = offset + bytes;
+        }
+
+        void inc( size_t& index ) const
+        {
+            if ( ++index == m_numBuckets ) index = 0;
+        }
+
+        // The first group::width control bytes and distances are mirrored
+        // after the end of the arrays so that a group load starting near the
+        // end wraps around without any special casing.
+        void setSlot( size_t i, ctrl::ctrl_t c, ctrl::dist_t dist )
+        {
+            m_ctrl[i] = c;
+            m_dist[i] = dist;
+            if ( i < group_t::width )
+            {
+                m_ctrl[m_numBuckets + i] = c;
+                m_dist[m_numBuckets + i] = dist;
+            }
+        }
+
+    private:
+        size_t                          m_numBuckets;
+        size_t                          m_size;
+        Reduction                       m_reduce;
+        std::vector<std::pair<K, V>>    m_cellData;
+        std::vector<ctrl::ctrl_t>       m_ctrl;
+        std::vector<ctrl::dist_t>       m_dist;
+    };
+
 private:
-    size_t bi( const K& k ) const
+    bool migrating() const { return m_old.numBuckets() != 0; }
+
+    template<typename Q>
+    const std::pair<K, V>* findCell( const Q& k ) const { return findCell( k, m_hashFn(k) ); }
+
+    template<typename Q>
+    const std::pair<K, V>* findCell( const Q& k, size_t hash ) const
+    {
+        size_t i = m_slots.findIndex( k, hash );
+        if ( i != invalidIndex ) return &m_slots.cell(i);
+
+        if ( migrating() )
+        {
+            i = m_old.findIndex( k, hash );
+            if ( i != invalidIndex ) return &m_old.cell(i);
+        }
+        return NULL;
+    }
+
+    template<typename Q>
+    std::pair<K, V>* findCell( const Q& k )
+    {
+        return const_cast<std::pair<K, V>*>( static_cast<const OpenAddressingHashTable*>( this )->findCell( k ) );
+    }
+
+    // Look the key up and, if it is absent, insert the element made by
+    // makeElement. Finding the key moves nothing, so pointers the caller
+    // holds stay valid; only a miss grows or migrates, before the insert so
+    // the returned value stays put.
+    template<typename MakeElement>
+    std::pair<V*, bool> findOrInsert( const K& key, MakeElement makeElement )
+    {
+        size_t hash = m_hashFn( key );
+        const std::pair<K, V>* cell = findCell( key, hash );
+        if ( cell != NULL ) return std::make_pair( const_cast<V*>( &cell->second ), false );
+
+        growIfRequired();
+        migrate( m_drainStep );
+
+        size_t i = m_slots.insert( makeElement(), hash );
+        return std::make_pair( &m_slots.cell(i).second, true );
+    }
+
+    // Smallest capacity that keeps count elements within the maximum load factor
+    size_t capacityFor( size_t count ) const
     {
-        return m_hashFn(k) % m_numBuckets;
+        size_t required = static_cast<size_t>( std::ceil( count / m_maxLoadFactor ) );
+        return Reduction::bucketCount( std::max( required, size_t( group_t::width ) ) );
     }
-    
-    void inc( size_t& index ) const { index = (index+1) % m_numBuckets; }
-    
-    size_t invalidIndex = std::numeric_limits<size_t>::max();
 
-    size_t findByIndex( const K& k ) const
+    // Move up to count slots from the draining generation into the current
+    // one. Erasing a moved slot shifts the rest of its run back, so stay on
+    // the same slot until it empties; everything before the cursor is then
+    // empty and no shift can carry an unmoved element behind it.
+    void migrate( size_t count )
     {
-        size_t oh = bi( k );
-        size_t i = oh;
-        while ( m_assigned[i] )
+        if ( !migrating() ) return;
+
+        for ( size_t step = 0; step < count && m_migrated < m_old.numBuckets(); ++step )
         {
-            auto el = m_cellData[i];
-            auto h = bi( el.first );
-            
-            // Either we've found the key, or we're no longer on this hash
-            if ( el.first == k ) return i;
-            else if ( h != oh ) return invalidIndex;
-            
-            inc(i);
+            if ( m_old.isFull( m_migrated ) )
+            {
+                auto& kv = m_old.cell( m_migrated );
+                m_slots.insert( std::move( kv ), m_hashFn( kv.first ) );
+                m_old.eraseAt( m_migrated );
+            }
+            else m_migrated++;
         }
-        return invalidIndex;
-    }  
-        
+
+        if ( m_migrated == m_old.numBuckets() ) m_old = SlotArray();
+    }
+
+    void finishMigration() { migrate( std::numeric_limits<size_t>::max() ); }
+
+    // Start moving everything into a fresh generation of slots, using the
+    // one prepared ahead if it is the right size. Unless incremental
+    // rehashing is enabled the move completes straight away; otherwise each
+    // insert and erase moves enough of it for the old generation to be gone
+    // by the time the next one is being filled in, well before the next
+    // growth.
+    void rehash( size_t numBuckets )
+    {
+        throwing_assert( !migrating(), "Previous rehash has not finished" );
+
+        if ( m_next.numBuckets() != numBuckets )
+        {
+            m_next = SlotArray();
+            m_next.allocate( numBuckets );
+        }
+        m_next.prepare( numBuckets );
+
+        std::swap( m_old, m_slots );
+        std::swap( m_slots, m_next );
+        m_migrated = 0;
+        HASH_STATS_ONLY( m_counters.rehashes++; )
+
+        // Each slot costs a step, plus one for each element moved out of it
+        size_t work = m_old.numBuckets() + m_old.size();
+        size_t from = prepareFrom( maxSize() );
+        size_t inserts = from > size() ? from - size() : 1;
+        m_drainStep = std::max( m_migrateStep, work / inserts + 1 );
+
+        if ( m_migrateStep == 0 ) finishMigration();
+    }
+
+    void countErase( size_t shifted )
+    {
+        HASH_STATS_ONLY( m_counters.eraseShifts += shifted; )
+    }
+
+    void rebuild( size_t numBuckets )
+    {
+        finishMigration();
+        rehash( numBuckets );
+        finishMigration();
+    }
+
+    // Make room for one more element, doubling the capacity once past the
+    // maximum load factor. Elements still waiting in the old generation are
+    // counted too, as they are all headed for the current one.
+    void growIfRequired()
+    {
+        size_t numBuckets = m_slots.numBuckets();
+        if ( m_migrateStep != 0 ) prepareNext( maxSize() );
+        if ( size() + 1 > numBuckets * m_maxLoadFactor ) rehash( Reduction::bucketCount( numBuckets * 2 ) );
+    }
+
+    // Most elements the current generation takes before the table grows
+    size_t maxSize() const { return static_cast<size_t>( m_slots.numBuckets() * m_maxLoadFactor ); }
+
+    // Element count from which the next generation is filled in
+    static size_t prepareFrom( size_t limit ) { return limit - limit / 4; }
+
+    // Filling in a fresh generation is as much work as moving into it, so
+    // with incremental rehashing that is spread out too: over the last
+    // quarter of the inserts before the table reaches limit elements, enough
+    // slots each time for the generation to be ready when it is needed.
+    void prepareNext( size_t limit )
+    {
+        if ( m_next.numBuckets() == 0 )
+        {
+            if ( migrating() || size() + 1 <= prepareFrom( limit ) ) return;
+
+            m_next.allocate( Reduction::bucketCount( m_slots.numBuckets() * 2 ) );
+            size_t inserts = limit > size() ? limit - size() : 1;
+            m_prepareStep = std::max( m_migrateStep, m_next.numBuckets() / inserts + 1 );
+        }
+        m_next.prepare( m_prepareStep );
+    }
+
 public:
     OpenAddressingHashTable( size_t initialCapacity ) :
-        m_numBuckets(initialCapacity),
-        m_size(0),
-        m_cellData( initialCapacity, std::make_pair( K(), V() ) ),
-        m_assigned( initialCapacity, false )
+        m_slots( Reduction::bucketCount( std::max( initialCapacity, size_t( group_t::width ) ) ) ),
+        m_migrated(0),
+        m_migrateStep(0),
+        m_drainStep(0),
+        m_prepareStep(0),
+        m_maxLoadFactor(0.875f)
+    {
+    }
+
+    size_t size() const { return m_slots.size() + m_old.size(); }
+
+    size_t capacity() const { return m_slots.numBuckets(); }
+
+    float load_factor() const { return static_cast<float>( size() ) / capacity(); }
+
+    float max_load_factor() const { return m_maxLoadFactor; }
+
+    void max_load_factor( float maxLoadFactor )
+    {
+        throwing_assert( maxLoadFactor > 0.0f && maxLoadFactor < 1.0f, "Maximum load factor must be in (0, 1)" );
+        m_maxLoadFactor = maxLoadFactor;
+        finishMigration();
+        if ( size() > capacity() * m_maxLoadFactor ) rebuild( capacityFor( size() ) );
+    }
+
+    // Spread each rehash over the following inserts and erases, moving at
+    // least slotsPerOperation slots each time, and more if that is needed to
+    // finish before the next rehash, so that no single operation pays for
+    // the whole table. The new slots are filled in ahead of time
+    // over the inserts leading up to it. Zero (the default) rehashes in one
+    // go. Lookups don't move anything, so a rehash left unfinished when
+    // the inserts stop stays that way, with every miss probing both
+    // generations, until the next insert or erase.
+    void incremental_rehash( size_t slotsPerOperation )
+    {
+        m_migrateStep = slotsPerOperation;
+        m_drainStep = std::max( m_drainStep, m_migrateStep );
+        if ( m_migrateStep == 0 ) finishMigration();
+    }
+
+    // Size the table so that count elements fit without a further rehash
+    void reserve( size_t count )
+    {
+        size_t required = capacityFor( count );
+        if ( required > capacity() ) rebuild( required );
+    }
+
+    void shrink_to_fit()
     {
+        size_t required = capacityFor( size() );
+        if ( required < capacity() ) rebuild( required );
     }
-    
-    size_t size() const { return m_size; }
-    
+
+    // Inserts without checking for an existing copy of the key. Use
+    // try_emplace or emplace for insert-if-absent.
     void insert( const std::pair<K, V>& v )
     {
-        size_t i = bi( v.first );
-        while ( m_assigned[i] )
-        {
-            inc(i);
-        }
-        m_cellData[i] = v;
-        m_assigned[i] = true;
-        m_size += 1;
-    }
-    
-    bool find( const K& k ) const { return findByIndex(k) != invalidIndex; }
-    
-    V get( const K& k )
-    {
-        size_t index = findByIndex(k);
-        throwing_assert( index != invalidIndex, "Key not found in get" );
-        return m_cellData[index].second;
-    }
-    
-    bool erase( const K& k )
-    {
-        auto kh = bi(k);
-        size_t i = findByIndex(k);
-        
-        if ( i == invalidIndex ) return false;
-        
-        size_t lastDup = i;
-        inc(i);
-        
-        // If this key is in the middle of a run, shift the run down
-        while ( m_assigned[i] && bi( m_cellData[i].first ) == kh )
-        {
-            std::swap( m_cellData[lastDup], m_cellData[i] );
-            lastDup = i;
-            inc(i);
-        }
-        
-        m_assigned[lastDup] = false;
-        m_size--;
-        
-        return true;
-    }
-    
+        growIfRequired();
+        m_slots.insert( v, m_hashFn( v.first ) );
+        migrate( m_drainStep );
+    }
+
+    void insert( std::pair<K, V>&& v )
+    {
+        growIfRequired();
+        size_t hash = m_hashFn( v.first );
+        m_slots.insert( std::move( v ), hash );
+        migrate( m_drainStep );
+    }
+
+    // Construct the value in place from args only if the key is absent.
+    // Returns the value for the key and whether it was inserted. Pointers
+    // into the table stay valid until the next insert or erase.
+    template<typename... Args>
+    std::pair<V*, bool> try_emplace( const K& key, Args&&... args )
+    {
+        return findOrInsert( key, [&]()
+        {
+            return std::pair<K, V>( std::piecewise_construct, std::forward_as_tuple( key ), std::forward_as_tuple( std::forward<Args>(args)... ) );
+        } );
+    }
+
+    template<typename... Args>
+    std::pair<V*, bool> try_emplace( K&& key, Args&&... args )
+    {
+        return findOrInsert( key, [&]()
+        {
+            return std::pair<K, V>( std::piecewise_construct, std::forward_as_tuple( std::move(key) ), std::forward_as_tuple( std::forward<Args>(args)... ) );
+        } );
+    }
+
+    // Build the element from args, then insert it only if its key is absent
+    template<typename... Args>
+    std::pair<V*, bool> emplace( Args&&... args )
+    {
+        std::pair<K, V> kv( std::forward<Args>(args)... );
+        return findOrInsert( kv.first, [&kv]() { return std::move(kv); } );
+    }
+
+    V& operator[]( const K& key ) { return *try_emplace( key ).first; }
+
+    // Lookups accept any key type that Hash accepts and K compares equal to,
+    // such as a const char* against std::string keys with StringHash.
+    template<typename Q>
+    bool find( const Q& k ) const { return findCell(k) != NULL; }
+
+    // The value for k, or NULL if it is absent
+    template<typename Q>
+    V* findPtr( const Q& k )
+    {
+        auto cell = findCell(k);
+        return cell == NULL ? NULL : &cell->second;
+    }
+
+    template<typename Q>
+    const V* findPtr( const Q& k ) const
+    {
+        auto cell = findCell(k);
+        return cell == NULL ? NULL : &cell->second;
+    }
+
+    template<typename Q>
+    V& get( const Q& k )
+    {
+        auto cell = findCell(k);
+        throwing_assert( cell != NULL, "Key not found in get" );
+        return cell->second;
+    }
+
+    template<typename Q>
+    const V& get( const Q& k ) const
+    {
+        auto cell = findCell(k);
+        throwing_assert( cell != NULL, "Key not found in get" );
+        return cell->second;
+    }
+
+    // Look up a batch of keys at once, leaving the value for each (or NULL)
+    // in out. Each chunk of keys is hashed and the slots it will probe are
+    // prefetched before any of them is resolved, so the cache misses for a
+    // chunk overlap rather than being taken one after another.
+    template<typename Q>
+    void find_batch( const std::vector<Q>& keys, std::vector<const V*>& out ) const
+    {
+        out.resize( keys.size() );
+
+        size_t hashes[batchSize];
+        for ( size_t start = 0; start < keys.size(); start += batchSize )
+        {
+            size_t end = std::min( start + batchSize, keys.size() );
+            for ( size_t i = start; i < end; ++i )
+            {
+                hashes[i - start] = m_hashFn( keys[i] );
+                m_slots.prefetch( hashes[i - start] );
+            }
+            for ( size_t i = start; i < end; ++i )
+            {
+                auto cell = findCell( keys[i], hashes[i - start] );
+                out[i] = cell == NULL ? NULL : &cell->second;
+            }
+        }
+    }
+
+    // As find_batch, but copying the values out. Throws if any key is absent.
+    template<typename Q>
+    void get_batch( const std::vector<Q>& keys, std::vector<V>& out ) const
+    {
+        std::vector<const V*> found;
+        find_batch( keys, found );
+
+        out.clear();
+        out.reserve( keys.size() );
+        for ( auto value : found )
+        {
+            throwing_assert( value != NULL, "Key not found in get_batch" );
+            out.push_back( *value );
+        }
+    }
+
+    // Call fn( key, value ) on every element, in no particular order
+    template<typename Fn>
+    void for_each( Fn fn )
+    {
+        for ( SlotArray* slots : { &m_slots, &m_old } )
+        {
+            for ( size_t i = 0; i < slots->numBuckets(); ++i )
+            {
+                if ( slots->isFull( i ) ) fn( const_cast<const K&>( slots->cell(i).first ), slots->cell(i).second );
+            }
+        }
+    }
+
+    // Write the table to path in the format of hashsnapshot.hpp, for
+    // MappedHashTable to serve straight from the file. Any rehash in progress
+    // is finished first. The file is written alongside and renamed into
+    // place, so processes with the old one mapped are left undisturbed.
+    void save( const std::string& path )
+    {
+        static_assert( std::is_trivially_copyable<K>::value && std::is_trivially_copyable<V>::value,
+            "Only tables of trivially copyable keys and values can be saved" );
+        finishMigration();
+
+        std::string tmpPath = path + ".tmp";
+        {
+            std::ofstream out( tmpPath.c_str(), std::ios::binary | std::ios::trunc );
+            throwing_assert( out.good(), "Failed to open " + tmpPath + " for writing" );
+
+            HashSnapshotHeader header = HashSnapshotHeader::make<K, V>( capacity(), size() );
+            out.write( reinterpret_cast<const char*>( &header ), sizeof(header) );
+            m_slots.write( out, header );
+            out.flush();
+            throwing_assert( out.good(), "Failed to write hash table snapshot to " + tmpPath );
+        }
+        throwing_assert( std::rename( tmpPath.c_str(), path.c_str() ) == 0, "Failed to rename " + tmpPath + " to " + path );
+    }
+
+    template<typename Q>
+    bool erase( const Q& k )
+    {
+        size_t hash = m_hashFn(k);
+        bool found = false;
+
+        size_t i = m_slots.findIndex( k, hash );
+        if ( i != invalidIndex )
+        {
+            countErase( m_slots.eraseAt( i ) );
+            found = true;
+        }
+        else if ( migrating() )
+        {
+            i = m_old.findIndex( k, hash );
+            if ( i != invalidIndex )
+            {
+                countErase( m_old.eraseAt( i ) );
+                found = true;
+            }
+        }
+
+        migrate( m_drainStep );
+        return found;
+    }
+
+#ifdef HASH_TABLE_STATS
+    // Probe lengths and clusters cover both generations during a rehash
+    OpenAddressingStats stats() const
+    {
+        OpenAddressingStats s;
+        s.size = size();
+        s.capacity = capacity();
+        s.loadFactor = load_factor();
+        s.rehashes = m_counters.rehashes;
+        s.eraseShifts = m_counters.eraseShifts;
+        m_slots.addStats( s );
+        if ( migrating() ) m_old.addStats( s );
+        return s;
+    }
+#endif
+
 private:
-    size_t                          m_numBuckets;
-    size_t                          m_size;
-    std::vector<std::pair<K, V>>    m_cellData;
-    std::vector<bool>               m_assigned;
-    std::hash<K>                    m_hashFn;
+    SlotArray                       m_slots;
+    SlotArray                       m_old;
+    SlotArray                       m_next;
+    size_t                          m_migrated;
+    size_t                          m_migrateStep;
+    size_t                          m_drainStep;
+    size_t                          m_prepareStep;
+    float                           m_maxLoadFactor;
+    Hash                            m_hashFn;
+    HASH_STATS_ONLY( HashStatsCounters m_counters; )
 };
-
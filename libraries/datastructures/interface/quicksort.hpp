@@ -1,35 +1,176 @@
-#include <deque>
+#pragma once
 
-template<typename T>
-void quickSort( std::vector<T>& data )
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <vector>
+#include <cstddef>
+
+#include "comparators.hpp"
+#include "sortingnetwork.hpp"
+
+// Ranges this short are left to insertion sort
+const size_t quickSortInsertionThreshold = 16;
+
+// Above this many elements the pivot is a ninther (median of three medians
+// of three) rather than a plain median of three
+const size_t quickSortNintherThreshold = 128;
+
+// Sort a short range by moving each element back into place, shifting the
+// larger ones up one at a time rather than swapping
+template<typename It, typename Cmp>
+void insertionSort( It first, It last, Cmp cmp )
+{
+    if ( first == last ) return;
+
+    for ( It i = first + 1; i != last; ++i )
+    {
+        if ( !cmp( *i, *(i - 1) ) ) continue;
+
+        auto value = std::move( *i );
+        It hole = i;
+        do
+        {
+            *hole = std::move( *(hole - 1) );
+            --hole;
+        }
+        while ( hole != first && cmp( value, *(hole - 1) ) );
+        *hole = std::move( value );
+    }
+}
+
+// The base case for ranges no longer than quickSortSmallSize: a sorting
+// network where there is one for the elements, else insertion sort
+template<typename It, typename Cmp>
+void quickSortSmall( It first, It last, Cmp, std::true_type )
+{
+    if ( first != last ) sortingNetworkSort( &*first, last - first );
+}
+
+template<typename It, typename Cmp>
+void quickSortSmall( It first, It last, Cmp cmp, std::false_type )
+{
+    insertionSort( first, last, cmp );
+}
+
+template<typename It, typename Cmp>
+size_t quickSortSmallSize()
+{
+    return UsesSortingNetwork<It, Cmp>::value ? sortingNetworkMaxSize : quickSortInsertionThreshold;
+}
+
+template<typename It, typename Cmp>
+It medianOfThree( It a, It b, It c, Cmp cmp )
+{
+    if ( cmp( *a, *b ) )
+    {
+        if ( cmp( *b, *c ) ) return b;
+        return cmp( *a, *c ) ? c : a;
+    }
+    if ( cmp( *a, *c ) ) return a;
+    return cmp( *b, *c ) ? c : b;
+}
+
+// Move a pivot to the front of [first, last). Sampling both ends and the
+// middle keeps sorted, reversed and organ pipe inputs splitting evenly.
+template<typename It, typename Cmp>
+void choosePivot( It first, It last, Cmp cmp )
 {
-    int length = data.size();
-    
-    std::deque<std::pair<int, int>> splits = { {0, length-1} };
-    
-    while( !splits.empty() )
+    size_t n = last - first;
+    It mid = first + n / 2;
+    It pivot;
+    if ( n > quickSortNintherThreshold )
     {
-        auto next = splits.front();
-        splits.pop_front();
-        
-        auto storeIndex = next.first;
-        auto pivotValue = data[next.second];
-        for ( int i = next.first; i < next.second-1; ++i )
+        size_t s = n / 8;
+        pivot = medianOfThree(
+            medianOfThree( first, first + s, first + 2 * s, cmp ),
+            medianOfThree( mid - s, mid, mid + s, cmp ),
+            medianOfThree( last - 1 - 2 * s, last - 1 - s, last - 1, cmp ), cmp );
+    }
+    else
+    {
+        pivot = medianOfThree( first, mid, last - 1, cmp );
+    }
+    std::iter_swap( first, pivot );
+}
+
+// Hoare partition around the pivot at *first. Both scans stop on elements
+// equal to the pivot, so runs of equal keys are shared between the two sides
+// instead of all landing on one. Returns where the pivot ends up.
+template<typename It, typename Cmp>
+It hoarePartition( It first, It last, Cmp cmp )
+{
+    It i = first + 1;
+    It j = last - 1;
+    while ( true )
+    {
+        while ( i <= j && cmp( *i, *first ) ) ++i;
+        while ( i <= j && cmp( *first, *j ) ) --j;
+        if ( i >= j ) break;
+        std::iter_swap( i++, j-- );
+    }
+    std::iter_swap( first, j );
+    return j;
+}
+
+// Introsort: quicksort that hands a range over to heapsort once it has been
+// split more than 2 log2(n) times, so no input can make it quadratic. The
+// smaller side of each split is sorted first and the larger one stacked, so
+// the stack never holds more than log2(n) ranges. Contiguous int32_t, float,
+// int64_t or double sorted ascending finish on sorting networks.
+template<typename It, typename Cmp>
+void quickSort( It first, It last, Cmp cmp )
+{
+    struct Range
+    {
+        It      first;
+        It      last;
+        size_t  depthLimit;
+    };
+
+    const size_t smallSize = quickSortSmallSize<It, Cmp>();
+    size_t depthLimit = 0;
+    for ( size_t n = last - first; n > 1; n /= 2 ) depthLimit += 2;
+
+    Range stack[sizeof(size_t) * 8];
+    size_t stackSize = 0;
+    Range next = { first, last, depthLimit };
+    while ( true )
+    {
+        size_t n = next.last - next.first;
+        if ( n <= smallSize || next.depthLimit == 0 )
         {
-            if ( data[i] < pivotValue )
+            if ( n <= smallSize )
+            {
+                quickSortSmall( next.first, next.last, cmp, UsesSortingNetwork<It, Cmp>() );
+            }
+            else
             {
-                std::swap( data[i], data[storeIndex] );
-                storeIndex += 1;
+                std::make_heap( next.first, next.last, cmp );
+                std::sort_heap( next.first, next.last, cmp );
             }
+
+            if ( stackSize == 0 ) break;
+            next = stack[--stackSize];
+            continue;
         }
-        std::swap( data[next.second], data[storeIndex] );
-        
-        auto left = std::make_pair( next.first, storeIndex-1 );
-        auto right = std::make_pair( storeIndex+1, next.second );
-        
-        if ( left.second > left.first ) splits.push_back( left );
-        if ( right.second > right.first ) splits.push_back( right );
+
+        choosePivot( next.first, next.last, cmp );
+        It pivot = hoarePartition( next.first, next.last, cmp );
+
+        Range left = { next.first, pivot, next.depthLimit - 1 };
+        Range right = { pivot + 1, next.last, next.depthLimit - 1 };
+        if ( left.last - left.first < right.last - right.first ) std::swap( left, right );
+        stack[stackSize++] = left;
+        next = right;
     }
 }
 
+template<typename It>
+void quickSort( It first, It last ) { quickSort( first, last, Less() ); }
+
+template<typename T, typename Cmp>
+void quickSort( std::vector<T>& data, Cmp cmp ) { quickSort( data.begin(), data.end(), cmp ); }
 
+template<typename T>
+void quickSort( std::vector<T>& data ) { quickSort( data.begin(), data.end(), Less() ); }
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "mergesort.hpp"
+
+// Below this many elements the radix sort's histograms cost more than a
+// (stable) comparison sort of the whole range
+const size_t radixSortThreshold = 256;
+
+// Maps a key to unsigned bits that order the same way as the key, so the
+// radix passes can treat every key type as an unsigned integer.
+template<typename T, bool isFloat = std::is_floating_point<T>::value>
+struct RadixTraits
+{
+    static_assert( std::is_integral<T>::value, "radixSort keys must be integers or floating point" );
+
+    typedef typename std::make_unsigned<T>::type bits_t;
+
+    // Flipping the sign bit puts negative numbers below positive ones
+    static bits_t encode( T key )
+    {
+        bits_t bits = static_cast<bits_t>( key );
+        if ( std::is_signed<T>::value ) bits ^= bits_t(1) << (sizeof(T) * 8 - 1);
+        return bits;
+    }
+};
+
+// IEEE floats: positive values just need the sign bit set, and negative ones
+// all their bits flipped, so larger magnitudes come out smaller. -0.0 sorts
+// before 0.0, and NaNs sort beyond the infinity of the same sign.
+template<typename T>
+struct RadixTraits<T, true>
+{
+    typedef typename std::conditional<sizeof(T) == 4, uint32_t, uint64_t>::type bits_t;
+    static_assert( sizeof(T) == sizeof(bits_t), "radixSort only handles 32 and 64 bit floating point" );
+
+    static bits_t encode( T key )
+    {
+        bits_t bits;
+        std::memcpy( &bits, &key, sizeof(bits) );
+        bits_t signBit = bits_t(1) << (sizeof(T) * 8 - 1);
+        return bits ^ ((bits & signBit) ? ~bits_t(0) : signBit);
+    }
+};
+
+// Returns the element itself, for sorting plain numbers
+struct Identity
+{
+    template<typename T>
+    const T& operator()( const T& value ) const { return value; }
+};
+
+// Move the n elements at from to their place for one digit in to
+template<typename Traits, typename In, typename Out, typename Key>
+void radixScatter( In from, size_t n, Out to, size_t* offsets, size_t shift, Key& key )
+{
+    for ( In it = from; it != from + n; ++it )
+    {
+        to[offsets[(Traits::encode( key( *it ) ) >> shift) & 0xFF]++] = std::move( *it );
+    }
+}
+
+// Radix sort the n elements at data, using buf (which starts empty) as the
+// other side of each scatter. Returns whether they ended up in buf.
+template<typename It, typename T, typename Key>
+bool radixSortInto( It data, std::vector<T>& buf, size_t n, Key key )
+{
+    typedef typename std::decay<decltype( key( *data ) )>::type K;
+    typedef RadixTraits<K> Traits;
+    typedef typename Traits::bits_t bits_t;
+
+    const size_t numPasses = sizeof(bits_t);
+    if ( n < radixSortThreshold )
+    {
+        return mergeSortInto( data, buf, n, [&key]( const T& a, const T& b ) { return Traits::encode( key( a ) ) < Traits::encode( key( b ) ); } );
+    }
+
+    size_t counts[numPasses][256] = {};
+    for ( It it = data; it != data + n; ++it )
+    {
+        bits_t bits = Traits::encode( key( *it ) );
+        for ( size_t pass = 0; pass < numPasses; ++pass ) counts[pass][(bits >> (pass * 8)) & 0xFF]++;
+    }
+
+    buf.resize( n );
+    bool inBuf = false;
+    for ( size_t pass = 0; pass < numPasses; ++pass )
+    {
+        // Turn the counts into where each digit's elements start
+        size_t* offsets = counts[pass];
+        bool constant = false;
+        size_t total = 0;
+        for ( size_t digit = 0; digit < 256; ++digit )
+        {
+            size_t count = offsets[digit];
+            if ( count == n ) constant = true;
+            offsets[digit] = total;
+            total += count;
+        }
+        if ( constant ) continue;
+
+        if ( inBuf ) radixScatter<Traits>( buf.begin(), n, data, offsets, pass * 8, key );
+        else radixScatter<Traits>( data, n, buf.begin(), offsets, pass * 8, key );
+        inBuf = !inBuf;
+    }
+    return inBuf;
+}
+
+// Stable LSD radix sort of [first, last) by key( element ), which must be an
+// integer or floating point value. One byte is sorted per pass, least
+// significant first, scattering between the range and a buffer of the same
+// size. Every pass's histogram is counted in a single read of the input up
+// front, and a pass is skipped outright when all the keys share its byte
+// (the top bytes of small or narrow-ranged keys, say). Elements must be
+// default constructible and movable, and key is called several times on
+// each so should be cheap.
+template<typename It, typename Key>
+void radixSort( It first, It last, Key key )
+{
+    std::vector<typename std::iterator_traits<It>::value_type> buf;
+    if ( radixSortInto( first, buf, last - first, key ) ) std::move( buf.begin(), buf.end(), first );
+}
+
+template<typename It>
+void radixSort( It first, It last ) { radixSort( first, last, Identity() ); }
+
+// A whole vector can just trade places with the buffer at the end
+template<typename T, typename Key>
+void radixSort( std::vector<T>& data, Key key )
+{
+    std::vector<T> buf;
+    if ( radixSortInto( data.begin(), buf, data.size(), key ) ) data.swap( buf );
+}
+
+template<typename T>
+void radixSort( std::vector<T>& data ) { radixSort( data, Identity() ); }
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <utility>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "comparators.hpp"
+#include "quicksort.hpp"
+#include "threadpool.hpp"
+
+// Below this many elements the sample sort just quickSorts on the calling
+// thread
+const size_t sampleSortThreshold = 1 << 16;
+
+// At most 2^this buckets, so a bucket index fits in a byte
+const size_t sampleSortMaxLogBuckets = 8;
+
+// Buckets are halved in number until they average at least this many
+// elements
+const size_t sampleSortMinBucketSize = 1 << 12;
+
+// Splitters are picked from a sorted sample this many times the number of
+// buckets, which keeps the buckets within a small factor of each other
+const size_t sampleSortOversampling = 16;
+
+// The splitters in the layout of a complete binary search tree, root first
+// and the children of node j at 2j and 2j + 1. Finding an element's bucket
+// is then the same number of steps down the tree whatever the element, each
+// step a comparison turned into an index rather than a branch.
+template<typename T, typename Cmp>
+class SplitterTree
+{
+public:
+    // splitters must be sorted and number 2^logBuckets - 1
+    SplitterTree( const std::vector<T>& splitters, size_t logBuckets, Cmp cmp ) :
+        m_tree( splitters.size() + 1 ),
+        m_logBuckets( logBuckets ),
+        m_cmp( cmp )
+    {
+        build( splitters, 1, 0, splitters.size() );
+    }
+
+    size_t numBuckets() const { return size_t(1) << m_logBuckets; }
+
+    // Elements equal to a splitter go in the bucket above it
+    template<typename It>
+    void classify( It first, size_t n, uint8_t* buckets ) const
+    {
+        // Several elements at once, so their descents overlap
+        const size_t group = 8;
+        size_t i = 0;
+        for ( ; i + group <= n; i += group )
+        {
+            size_t j[group];
+            for ( size_t g = 0; g < group; ++g ) j[g] = 1;
+            for ( size_t level = 0; level < m_logBuckets; ++level )
+            {
+                for ( size_t g = 0; g < group; ++g ) j[g] = 2 * j[g] + !m_cmp( first[i + g], m_tree[j[g]] );
+            }
+            for ( size_t g = 0; g < group; ++g ) buckets[i + g] = uint8_t( j[g] - numBuckets() );
+        }
+
+        for ( ; i < n; ++i )
+        {
+            size_t j = 1;
+            for ( size_t level = 0; level < m_logBuckets; ++level ) j = 2 * j + !m_cmp( first[i], m_tree[j] );
+            buckets[i] = uint8_t( j - numBuckets() );
+        }
+    }
+
+private:
+    void build( const std::vector<T>& splitters, size_t node, size_t lo, size_t hi )
+    {
+        if ( lo == hi ) return;
+
+        size_t mid = lo + (hi - lo) / 2;
+        m_tree[node] = splitters[mid];
+        build( splitters, 2 * node, lo, mid );
+        build( splitters, 2 * node + 1, mid + 1, hi );
+    }
+
+private:
+    std::vector<T>  m_tree;
+    size_t          m_logBuckets;
+    Cmp             m_cmp;
+};
+
+// Sort the n elements at data, using buf, which must hold n elements, in
+// three parallel steps: classify every element against the splitters, move
+// each into its bucket's place in buf, and quickSort the buckets. The sorted
+// elements end up in buf, or are moved back to data when moveBack is set.
+template<typename It, typename T, typename Cmp>
+void sampleSortInto( It data, std::vector<T>& buf, size_t n, ThreadPool& pool, bool moveBack, Cmp cmp )
+{
+    size_t logBuckets = sampleSortMaxLogBuckets;
+    while ( logBuckets > 1 && (n >> logBuckets) < sampleSortMinBucketSize ) logBuckets--;
+    size_t numBuckets = size_t(1) << logBuckets;
+
+    // A fixed seed keeps runs repeatable; quickSort still bounds the worst
+    // case within a bucket
+    std::vector<T> sample;
+    std::minstd_rand gen( static_cast<std::minstd_rand::result_type>( n ) );
+    std::uniform_int_distribution<size_t> position( 0, n - 1 );
+    for ( size_t i = 0; i < numBuckets * sampleSortOversampling; ++i ) sample.push_back( data[position( gen )] );
+    quickSort( sample.begin(), sample.end(), cmp );
+
+    std::vector<T> splitters;
+    for ( size_t b = 1; b < numBuckets; ++b ) splitters.push_back( sample[b * sampleSortOversampling] );
+    SplitterTree<T, Cmp> tree( splitters, logBuckets, cmp );
+
+    // counts[c * numBuckets + b] is how many of chunk c's elements go in
+    // bucket b, then where in buf the first of them goes
+    size_t numChunks = pool.size();
+    std::vector<size_t> counts( numChunks * numBuckets, 0 );
+    std::vector<uint8_t> buckets( n );
+    pool.run( numChunks, [&]( size_t c )
+    {
+        size_t start = n * c / numChunks;
+        size_t end = n * (c + 1) / numChunks;
+        tree.classify( data + start, end - start, buckets.data() + start );
+
+        size_t* chunkCounts = counts.data() + c * numBuckets;
+        for ( size_t i = start; i < end; ++i ) chunkCounts[buckets[i]]++;
+    } );
+
+    // Buckets in order, and within each bucket the chunks in order
+    std::vector<size_t> bounds( numBuckets + 1, 0 );
+    size_t offset = 0;
+    for ( size_t b = 0; b < numBuckets; ++b )
+    {
+        bounds[b] = offset;
+        for ( size_t c = 0; c < numChunks; ++c )
+        {
+            size_t count = counts[c * numBuckets + b];
+            counts[c * numBuckets + b] = offset;
+            offset += count;
+        }
+    }
+    bounds[numBuckets] = n;
+
+    pool.run( numChunks, [&]( size_t c )
+    {
+        size_t start = n * c / numChunks;
+        size_t end = n * (c + 1) / numChunks;
+        size_t* next = counts.data() + c * numBuckets;
+        for ( size_t i = start; i < end; ++i ) buf[next[buckets[i]]++] = std::move( data[i] );
+    } );
+
+    // Largest buckets first, so a big one doesn't start last and leave the
+    // other threads idle
+    std::vector<size_t> order( numBuckets );
+    for ( size_t b = 0; b < numBuckets; ++b ) order[b] = b;
+    std::sort( order.begin(), order.end(), [&]( size_t a, size_t b )
+    {
+        return bounds[a + 1] - bounds[a] > bounds[b + 1] - bounds[b];
+    } );
+
+    pool.run( numBuckets, [&]( size_t i )
+    {
+        size_t b = order[i];
+        auto first = buf.begin() + bounds[b];
+        auto last = buf.begin() + bounds[b + 1];
+
+        // A value sampled often enough to be more than one splitter is
+        // common in the input, and all its copies are in the bucket above
+        // it. They need no sorting once moved to the front.
+        if ( b >= 2 && !cmp( splitters[b - 2], splitters[b - 1] ) )
+        {
+            const T& common = splitters[b - 1];
+            first = std::partition( first, last, [&]( const T& x ) { return !cmp( common, x ); } );
+        }
+        quickSort( first, last, cmp );
+
+        if ( moveBack ) std::move( buf.begin() + bounds[b], last, data + bounds[b] );
+    } );
+}
+
+// Parallel sample sort on pool. Splitters picked from a random sample cut
+// the input into up to 256 buckets of roughly equal size, every element is
+// moved once into its bucket, and the buckets are sorted independently. So
+// unlike the parallel mergeSort there are no merge passes: the data crosses
+// memory twice, once out to the buckets and once back. Elements must be
+// default constructible, for the scratch buffer, and the sort is not stable.
+// A value common enough to fill several buckets' worth of the sample is set
+// apart in its bucket rather than sorted.
+template<typename It, typename Cmp>
+void sampleSort( It first, It last, ThreadPool& pool, Cmp cmp )
+{
+    size_t n = last - first;
+    if ( pool.size() == 1 || n < sampleSortThreshold )
+    {
+        quickSort( first, last, cmp );
+        return;
+    }
+
+    std::vector<typename std::iterator_traits<It>::value_type> buf( n );
+    sampleSortInto( first, buf, n, pool, true, cmp );
+}
+
+template<typename It>
+void sampleSort( It first, It last, ThreadPool& pool ) { sampleSort( first, last, pool, Less() ); }
+
+// A whole vector can just trade places with the buffer at the end
+template<typename T, typename Cmp>
+void sampleSort( std::vector<T>& data, ThreadPool& pool, Cmp cmp )
+{
+    size_t n = data.size();
+    if ( pool.size() == 1 || n < sampleSortThreshold )
+    {
+        quickSort( data.begin(), data.end(), cmp );
+        return;
+    }
+
+    std::vector<T> buf( n );
+    sampleSortInto( data.begin(), buf, n, pool, false, cmp );
+    data.swap( buf );
+}
+
+template<typename T>
+void sampleSort( std::vector<T>& data, ThreadPool& pool ) { sampleSort( data, pool, Less() ); }
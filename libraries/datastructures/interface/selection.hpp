@@ -0,0 +1,100 @@
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+#include <cstddef>
+
+#include "comparators.hpp"
+#include "heap.hpp"
+#include "quicksort.hpp"
+
+// The k elements that come first in cmp's order, in that order: the top k
+// by score with std::greater, say. A heap holds the best k seen so far with
+// the worst of them on top, and a later element only goes in if it beats
+// that one, so most of a long input costs a single comparison and the whole
+// takes O(n log k). It reads the input once, front to back, so any input
+// range will do, and holds k elements rather than a copy of the input. Of
+// elements equal to the k-th, the first seen are kept.
+template<typename It, typename Cmp>
+std::vector<typename std::iterator_traits<It>::value_type> topK( It first, It last, size_t k, Cmp cmp )
+{
+    typedef typename std::iterator_traits<It>::value_type T;
+
+    std::vector<T> result;
+    if ( k == 0 ) return result;
+
+    heap<T, Reversed<Cmp>> best( (Reversed<Cmp>( cmp )) );
+    for ( ; first != last; ++first )
+    {
+        if ( best.size() < k ) best.push( *first );
+        else if ( cmp( *first, best.top() ) ) best.replaceTop( *first );
+    }
+
+    // The heap gives up the worst first
+    result.reserve( best.size() );
+    while ( !best.empty() ) result.push_back( best.pop() );
+    std::reverse( result.begin(), result.end() );
+    return result;
+}
+
+template<typename It>
+std::vector<typename std::iterator_traits<It>::value_type> topK( It first, It last, size_t k ) { return topK( first, last, k, Less() ); }
+
+template<typename T, typename Cmp>
+std::vector<T> topK( const std::vector<T>& data, size_t k, Cmp cmp ) { return topK( data.begin(), data.end(), k, cmp ); }
+
+template<typename T>
+std::vector<T> topK( const std::vector<T>& data, size_t k ) { return topK( data.begin(), data.end(), k, Less() ); }
+
+// Rearrange [first, last) so that *nth is the element a sort would put
+// there, with none after it less than it and none before it greater.
+// Introselect: quickSort's partitioning, following only the side that holds
+// nth, which takes O(n) on average. Should a run of bad pivots use up the
+// same 2 log2(n) depth limit quickSort has, the rest of the range is sorted
+// instead, so no input takes more than O(n log n).
+template<typename It, typename Cmp>
+void nthElement( It first, It nth, It last, Cmp cmp )
+{
+    if ( nth == last ) return;
+
+    const size_t smallSize = quickSortSmallSize<It, Cmp>();
+    size_t depthLimit = 0;
+    for ( size_t n = last - first; n > 1; n /= 2 ) depthLimit += 2;
+
+    while ( size_t( last - first ) > smallSize )
+    {
+        if ( depthLimit-- == 0 )
+        {
+            quickSort( first, last, cmp );
+            return;
+        }
+
+        choosePivot( first, last, cmp );
+        It pivot = hoarePartition( first, last, cmp );
+        if ( pivot == nth ) return;
+
+        if ( nth < pivot ) last = pivot;
+        else first = pivot + 1;
+    }
+    quickSortSmall( first, last, cmp, UsesSortingNetwork<It, Cmp>() );
+}
+
+template<typename It>
+void nthElement( It first, It nth, It last ) { nthElement( first, nth, last, Less() ); }
+
+// Sort the elements that belong in [first, middle) into place, leaving the
+// rest in [middle, last) in no particular order. Selecting the boundary
+// with nthElement and then sorting only what comes before it takes
+// O(n + k log k) for k = middle - first.
+template<typename It, typename Cmp>
+void partialSort( It first, It middle, It last, Cmp cmp )
+{
+    if ( first == middle ) return;
+
+    nthElement( first, middle - 1, last, cmp );
+    quickSort( first, middle - 1, cmp );
+}
+
+template<typename It>
+void partialSort( It first, It middle, It last ) { partialSort( first, middle, last, Less() ); }
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <future>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Reads a file front to back in large blocks. After each read the kernel is
+// asked to start fetching the next block, so the disk is busy with it while
+// the caller works through this one.
+class SequentialReader
+{
+public:
+    SequentialReader( const std::string& path, size_t blockBytes );
+    ~SequentialReader();
+
+    SequentialReader( const SequentialReader& ) = delete;
+    SequentialReader& operator=( const SequentialReader& ) = delete;
+
+    // Reads up to bytes into dest, returning how many were read: fewer only
+    // at the end of the file
+    size_t read( char* dest, size_t bytes );
+
+    uint64_t size() const { return m_size; }
+
+private:
+    std::string     m_path;
+    int             m_fd;
+    uint64_t        m_size;
+    uint64_t        m_offset;
+    size_t          m_blockBytes;
+};
+
+// Writes a file front to back through two blocks of buffer: while one is
+// being written out on a background thread the caller fills the other.
+class SequentialWriter
+{
+public:
+    SequentialWriter( const std::string& path, size_t blockBytes );
+
+    // Closes without reporting errors, so call close() to find out whether
+    // everything made it to the file
+    ~SequentialWriter();
+
+    SequentialWriter( const SequentialWriter& ) = delete;
+    SequentialWriter& operator=( const SequentialWriter& ) = delete;
+
+    void write( const char* data, size_t bytes );
+
+    // Writes out whatever is buffered and closes the file
+    void close();
+
+private:
+    void flush();
+    void wait();
+
+private:
+    std::string         m_path;
+    int                 m_fd;
+    size_t              m_blockBytes;
+    std::vector<char>   m_filling;
+    std::vector<char>   m_writing;
+    std::future<void>   m_pending;
+};
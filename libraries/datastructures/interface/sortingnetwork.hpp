@@ -0,0 +1,373 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// GCC 4.9 and later can compile functions for an instruction set the rest of
+// the build doesn't assume, so the AVX2 and SSE4.1 networks are built
+// whatever the flags and picked at run time by what the CPU supports. With
+// an older compiler only what -m flags enable is built.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(__clang__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define SORTING_NETWORK_DISPATCH
+#endif
+
+#if defined(SORTING_NETWORK_DISPATCH) || defined(__AVX2__)
+#define SORTING_NETWORK_AVX2
+#endif
+
+#if defined(SORTING_NETWORK_DISPATCH) || defined(__SSE4_1__)
+#define SORTING_NETWORK_SSE4_1
+#endif
+
+#if defined(SORTING_NETWORK_AVX2) || defined(SORTING_NETWORK_SSE4_1)
+#include <immintrin.h>
+#endif
+
+#include "comparators.hpp"
+
+// Bitonic sorting networks for blocks of up to 32 int32_t, float, int64_t or
+// double, used by the sorts as their base case. A network makes the same
+// compare-exchanges whatever the data, each one a min and a max, so there
+// are no branches on the values to mispredict. Where the CPU has AVX2 (or
+// SSE4.1) each compare-exchange works on a whole register of lanes at once;
+// otherwise they are scalar min/max, which compile to conditional moves.
+//
+// Floating point blocks must not hold NaNs, and zeros of either sign may
+// come out in either order (they compare equal but are not identical).
+const size_t sortingNetworkMaxSize = 32;
+
+// The instruction sets there are networks for, in order
+enum class SortingNetworkIsa
+{
+    scalar,
+    sse41,
+    avx2
+};
+
+namespace sortingnetwork
+{
+    // A register of one lane, for types or targets without SIMD support
+    template<typename T>
+    struct ScalarLanes
+    {
+        typedef T reg_t;
+        static const size_t width = 1;
+
+        static reg_t load( const T* p ) { return *p; }
+        static void store( T* p, reg_t v ) { *p = v; }
+        static reg_t min( reg_t a, reg_t b ) { return b < a ? b : a; }
+        static reg_t max( reg_t a, reg_t b ) { return b < a ? a : b; }
+        static reg_t reverse( reg_t v ) { return v; }
+        static reg_t sort( reg_t v ) { return v; }
+        static reg_t merge( reg_t v ) { return v; }
+    };
+
+    // Fills the slots past the end of a block, sorting after every value
+    template<typename T>
+    T padding()
+    {
+        return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
+    }
+
+    namespace scalar
+    {
+#include "sortingnetworkkernel.hpp"
+    }
+}
+
+#ifdef SORTING_NETWORK_SSE4_1
+#ifdef SORTING_NETWORK_DISPATCH
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#endif
+namespace sortingnetwork
+{
+    namespace sse41
+    {
+        struct Int32x4
+        {
+            typedef int32_t value_t;
+            typedef __m128i reg_t;
+
+            static reg_t load( const int32_t* p ) { return _mm_loadu_si128( reinterpret_cast<const __m128i*>( p ) ); }
+            static void store( int32_t* p, reg_t v ) { _mm_storeu_si128( reinterpret_cast<__m128i*>( p ), v ); }
+            static reg_t min( reg_t a, reg_t b ) { return _mm_min_epi32( a, b ); }
+            static reg_t max( reg_t a, reg_t b ) { return _mm_max_epi32( a, b ); }
+
+            template<int order>
+            static reg_t permute( reg_t v ) { return _mm_shuffle_epi32( v, order ); }
+
+            template<int mask>
+            static reg_t blend( reg_t a, reg_t b )
+            {
+                return _mm_castps_si128( _mm_blend_ps( _mm_castsi128_ps( a ), _mm_castsi128_ps( b ), mask ) );
+            }
+        };
+
+        struct Floatx4
+        {
+            typedef float value_t;
+            typedef __m128 reg_t;
+
+            static reg_t load( const float* p ) { return _mm_loadu_ps( p ); }
+            static void store( float* p, reg_t v ) { _mm_storeu_ps( p, v ); }
+            static reg_t min( reg_t a, reg_t b ) { return _mm_min_ps( a, b ); }
+            static reg_t max( reg_t a, reg_t b ) { return _mm_max_ps( a, b ); }
+
+            template<int order>
+            static reg_t permute( reg_t v ) { return _mm_shuffle_ps( v, v, order ); }
+
+            template<int mask>
+            static reg_t blend( reg_t a, reg_t b ) { return _mm_blend_ps( a, b, mask ); }
+        };
+
+        struct Doublex2
+        {
+            typedef double value_t;
+            typedef __m128d reg_t;
+            static const size_t width = 2;
+
+            static reg_t load( const double* p ) { return _mm_loadu_pd( p ); }
+            static void store( double* p, reg_t v ) { _mm_storeu_pd( p, v ); }
+            static reg_t min( reg_t a, reg_t b ) { return _mm_min_pd( a, b ); }
+            static reg_t max( reg_t a, reg_t b ) { return _mm_max_pd( a, b ); }
+            static reg_t reverse( reg_t v ) { return _mm_shuffle_pd( v, v, 1 ); }
+            static reg_t merge( reg_t v ) { return sort( v ); }
+
+            static reg_t sort( reg_t v )
+            {
+                reg_t p = reverse( v );
+                return _mm_blend_pd( min( v, p ), max( v, p ), 2 );
+            }
+        };
+
+#include "sortingnetworkkernel.hpp"
+
+        template<> struct LanesFor<int32_t> { typedef Lanes4<Int32x4> type; };
+        template<> struct LanesFor<float> { typedef Lanes4<Floatx4> type; };
+        template<> struct LanesFor<double> { typedef Doublex2 type; };
+    }
+}
+#ifdef SORTING_NETWORK_DISPATCH
+#pragma GCC pop_options
+#endif
+#endif
+
+#ifdef SORTING_NETWORK_AVX2
+#ifdef SORTING_NETWORK_DISPATCH
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+namespace sortingnetwork
+{
+    namespace avx2
+    {
+        struct Int32x8
+        {
+            typedef int32_t value_t;
+            typedef __m256i reg_t;
+
+            static reg_t load( const int32_t* p ) { return _mm256_loadu_si256( reinterpret_cast<const __m256i*>( p ) ); }
+            static void store( int32_t* p, reg_t v ) { _mm256_storeu_si256( reinterpret_cast<__m256i*>( p ), v ); }
+            static reg_t min( reg_t a, reg_t b ) { return _mm256_min_epi32( a, b ); }
+            static reg_t max( reg_t a, reg_t b ) { return _mm256_max_epi32( a, b ); }
+            static reg_t permute( reg_t v, __m256i index ) { return _mm256_permutevar8x32_epi32( v, index ); }
+
+            template<int mask>
+            static reg_t blend( reg_t a, reg_t b ) { return _mm256_blend_epi32( a, b, mask ); }
+        };
+
+        struct Floatx8
+        {
+            typedef float value_t;
+            typedef __m256 reg_t;
+
+            static reg_t load( const float* p ) { return _mm256_loadu_ps( p ); }
+            static void store( float* p, reg_t v ) { _mm256_storeu_ps( p, v ); }
+            static reg_t min( reg_t a, reg_t b ) { return _mm256_min_ps( a, b ); }
+            static reg_t max( reg_t a, reg_t b ) { return _mm256_max_ps( a, b ); }
+            static reg_t permute( reg_t v, __m256i index ) { return _mm256_permutevar8x32_ps( v, index ); }
+
+            template<int mask>
+            static reg_t blend( reg_t a, reg_t b ) { return _mm256_blend_ps( a, b, mask ); }
+        };
+
+        // Bitonic sort within an eight lane register. Each step pairs every lane
+        // with the one d lanes away and keeps the max in the lanes set in the
+        // step's mask and the min in the rest.
+        template<typename Ops>
+        struct Lanes8 : Ops
+        {
+            typedef typename Ops::reg_t reg_t;
+            static const size_t width = 8;
+
+            template<int mask>
+            static reg_t exchange( reg_t v, __m256i partner )
+            {
+                reg_t p = Ops::permute( v, partner );
+                return Ops::template blend<mask>( Ops::min( v, p ), Ops::max( v, p ) );
+            }
+
+            static __m256i distance1() { return _mm256_setr_epi32( 1, 0, 3, 2, 5, 4, 7, 6 ); }
+            static __m256i distance2() { return _mm256_setr_epi32( 2, 3, 0, 1, 6, 7, 4, 5 ); }
+            static __m256i distance4() { return _mm256_setr_epi32( 4, 5, 6, 7, 0, 1, 2, 3 ); }
+
+            static reg_t reverse( reg_t v ) { return Ops::permute( v, _mm256_setr_epi32( 7, 6, 5, 4, 3, 2, 1, 0 ) ); }
+
+            // Sorts a register holding a bitonic sequence
+            static reg_t merge( reg_t v )
+            {
+                v = exchange<0xF0>( v, distance4() );
+                v = exchange<0xCC>( v, distance2() );
+                return exchange<0xAA>( v, distance1() );
+            }
+
+            static reg_t sort( reg_t v )
+            {
+                v = exchange<0x66>( v, distance1() );
+                v = exchange<0x3C>( v, distance2() );
+                v = exchange<0x5A>( v, distance1() );
+                return merge( v );
+            }
+        };
+
+        // AVX2 has no 64 bit integer min or max, so they are built from a compare
+        struct Int64x4
+        {
+            typedef int64_t value_t;
+            typedef __m256i reg_t;
+
+            static reg_t load( const int64_t* p ) { return _mm256_loadu_si256( reinterpret_cast<const __m256i*>( p ) ); }
+            static void store( int64_t* p, reg_t v ) { _mm256_storeu_si256( reinterpret_cast<__m256i*>( p ), v ); }
+            static reg_t min( reg_t a, reg_t b ) { return _mm256_blendv_epi8( a, b, _mm256_cmpgt_epi64( a, b ) ); }
+            static reg_t max( reg_t a, reg_t b ) { return _mm256_blendv_epi8( b, a, _mm256_cmpgt_epi64( a, b ) ); }
+
+            template<int order>
+            static reg_t permute( reg_t v ) { return _mm256_permute4x64_epi64( v, order ); }
+
+            template<int mask>
+            static reg_t blend( reg_t a, reg_t b )
+            {
+                return _mm256_castpd_si256( _mm256_blend_pd( _mm256_castsi256_pd( a ), _mm256_castsi256_pd( b ), mask ) );
+            }
+        };
+
+        struct Doublex4
+        {
+            typedef double value_t;
+            typedef __m256d reg_t;
+
+            static reg_t load( const double* p ) { return _mm256_loadu_pd( p ); }
+            static void store( double* p, reg_t v ) { _mm256_storeu_pd( p, v ); }
+            static reg_t min( reg_t a, reg_t b ) { return _mm256_min_pd( a, b ); }
+            static reg_t max( reg_t a, reg_t b ) { return _mm256_max_pd( a, b ); }
+
+            template<int order>
+            static reg_t permute( reg_t v ) { return _mm256_permute4x64_pd( v, order ); }
+
+            template<int mask>
+            static reg_t blend( reg_t a, reg_t b ) { return _mm256_blend_pd( a, b, mask ); }
+        };
+
+#include "sortingnetworkkernel.hpp"
+
+        template<> struct LanesFor<int32_t> { typedef Lanes8<Int32x8> type; };
+        template<> struct LanesFor<float> { typedef Lanes8<Floatx8> type; };
+        template<> struct LanesFor<int64_t> { typedef Lanes4<Int64x4> type; };
+        template<> struct LanesFor<double> { typedef Lanes4<Doublex4> type; };
+    }
+}
+#ifdef SORTING_NETWORK_DISPATCH
+#pragma GCC pop_options
+#endif
+#endif
+
+namespace sortingnetwork
+{
+    inline SortingNetworkIsa detectIsa()
+    {
+#if defined(SORTING_NETWORK_DISPATCH)
+        __builtin_cpu_init();
+        if ( __builtin_cpu_supports( "avx2" ) ) return SortingNetworkIsa::avx2;
+        if ( __builtin_cpu_supports( "sse4.1" ) ) return SortingNetworkIsa::sse41;
+        return SortingNetworkIsa::scalar;
+#elif defined(SORTING_NETWORK_AVX2)
+        return SortingNetworkIsa::avx2;
+#elif defined(SORTING_NETWORK_SSE4_1)
+        return SortingNetworkIsa::sse41;
+#else
+        return SortingNetworkIsa::scalar;
+#endif
+    }
+}
+
+// The best instruction set both this build and the CPU support, found once
+inline SortingNetworkIsa sortingNetworkIsa()
+{
+    static const SortingNetworkIsa isa = sortingnetwork::detectIsa();
+    return isa;
+}
+
+template<typename T>
+struct HasSortingNetwork : std::integral_constant<bool,
+    std::is_same<T, int32_t>::value || std::is_same<T, float>::value ||
+    std::is_same<T, int64_t>::value || std::is_same<T, double>::value>
+{
+};
+
+// Whether a sort of [It, It) by Cmp can hand small blocks to
+// sortingNetworkSort: the elements must be contiguous and one of the network
+// types, and the order ascending
+template<typename It, typename Cmp>
+struct UsesSortingNetwork : std::integral_constant<bool,
+    HasSortingNetwork<typename std::iterator_traits<It>::value_type>::value &&
+    (std::is_pointer<It>::value || std::is_same<It, typename std::vector<typename std::iterator_traits<It>::value_type>::iterator>::value) &&
+    (std::is_same<Cmp, Less>::value || std::is_same<Cmp, std::less<typename std::iterator_traits<It>::value_type>>::value)>
+{
+};
+
+// Sort up to sortingNetworkMaxSize elements in ascending order, with the
+// network for isa (or the best below it this build has). The block is padded
+// out to 8, 16 or 32 elements, whichever is the first to fit.
+template<typename T>
+void sortingNetworkSort( T* data, size_t n, SortingNetworkIsa isa )
+{
+    static_assert( HasSortingNetwork<T>::value, "No sorting network for this type" );
+
+    if ( n < 2 ) return;
+
+    size_t blockSize = n <= 8 ? 8 : n <= 16 ? 16 : sortingNetworkMaxSize;
+    T block[sortingNetworkMaxSize];
+    std::copy( data, data + n, block );
+    std::fill( block + n, block + blockSize, sortingnetwork::padding<T>() );
+
+    switch ( isa )
+    {
+#ifdef SORTING_NETWORK_AVX2
+    case SortingNetworkIsa::avx2:
+        sortingnetwork::avx2::sortBlock( block, blockSize );
+        break;
+#endif
+#ifdef SORTING_NETWORK_SSE4_1
+    case SortingNetworkIsa::sse41:
+        sortingnetwork::sse41::sortBlock( block, blockSize );
+        break;
+#endif
+    default:
+        sortingnetwork::scalar::sortBlock( block, blockSize );
+        break;
+    }
+
+    std::copy( block, block + n, data );
+}
+
+// As above, with the best network the CPU supports
+template<typename T>
+void sortingNetworkSort( T* data, size_t n ) { sortingNetworkSort( data, n, sortingNetworkIsa() ); }
@@ -0,0 +1,102 @@
+// The network code that is the same for every instruction set.
+// sortingnetwork.hpp includes this once inside each of its sortingnetwork::
+// scalar, sse41 and avx2 namespaces, after that namespace's register types
+// and (for the SIMD ones) inside the pragma that lets them use the set's
+// instructions, so each gets its own copy compiled for its target. That is
+// why there is no include guard; nothing else should include it.
+
+// Bitonic sort within a four lane register whose permutes take an
+// immediate. Each step pairs every lane with its partner and keeps the max
+// in the lanes set in the step's mask and the min in the rest.
+template<typename Ops>
+struct Lanes4 : Ops
+{
+    typedef typename Ops::reg_t reg_t;
+    static const size_t width = 4;
+
+    // Lane orders for _MM_SHUFFLE-style immediates
+    static const int distance1 = 0xB1;
+    static const int distance2 = 0x4E;
+    static const int reversed = 0x1B;
+
+    template<int mask, int partner>
+    static reg_t exchange( reg_t v )
+    {
+        reg_t p = Ops::template permute<partner>( v );
+        return Ops::template blend<mask>( Ops::min( v, p ), Ops::max( v, p ) );
+    }
+
+    static reg_t reverse( reg_t v ) { return Ops::template permute<reversed>( v ); }
+
+    static reg_t merge( reg_t v )
+    {
+        v = exchange<0xC, distance2>( v );
+        return exchange<0xA, distance1>( v );
+    }
+
+    static reg_t sort( reg_t v ) { return merge( exchange<0x6, distance1>( v ) ); }
+};
+
+// The lanes each type is sorted in; the SIMD namespaces specialize this
+template<typename T>
+struct LanesFor
+{
+    typedef ScalarLanes<T> type;
+};
+
+// Bitonic merge of the sorted halves of registers [0, 2 * half) into one
+// sorted sequence. Comparing each element of the first half with its
+// mirror image in the second leaves the smaller half of the elements in
+// the first half and the larger in the second, each bitonic; then
+// exchanges at halving distances sort both.
+template<typename L>
+void mergeRegisters( typename L::reg_t* r, size_t half )
+{
+    for ( size_t j = 0; j < half; ++j )
+    {
+        typename L::reg_t x = r[j];
+        typename L::reg_t y = L::reverse( r[2 * half - 1 - j] );
+        r[j] = L::min( x, y );
+        r[2 * half - 1 - j] = L::reverse( L::max( x, y ) );
+    }
+
+    for ( size_t d = half / 2; d > 0; d /= 2 )
+    {
+        for ( size_t i = 0; i < 2 * half; ++i )
+        {
+            if ( i & d ) continue;
+
+            typename L::reg_t x = r[i];
+            r[i] = L::min( x, r[i + d] );
+            r[i + d] = L::max( x, r[i + d] );
+        }
+    }
+
+    for ( size_t i = 0; i < 2 * half; ++i ) r[i] = L::merge( r[i] );
+}
+
+template<typename L>
+void sortRegisters( typename L::reg_t* r, size_t count )
+{
+    for ( size_t i = 0; i < count; ++i ) r[i] = L::sort( r[i] );
+    for ( size_t half = 1; half < count; half *= 2 )
+    {
+        for ( size_t i = 0; i < count; i += 2 * half ) mergeRegisters<L>( r + i, half );
+    }
+}
+
+// Sort a block of blockSize elements, a multiple of the register width
+// no larger than sortingNetworkMaxSize. The registers never leave this
+// function, so only pointers cross from code built for another target.
+template<typename T>
+void sortBlock( T* block, size_t blockSize )
+{
+    typedef typename LanesFor<T>::type L;
+
+    const size_t width = L::width;
+    typename L::reg_t regs[sortingNetworkMaxSize / width];
+    size_t count = blockSize / width;
+    for ( size_t i = 0; i < count; ++i ) regs[i] = L::load( block + i * width );
+    sortRegisters<L>( regs, count );
+    for ( size_t i = 0; i < count; ++i ) L::store( block + i * width, regs[i] );
+}
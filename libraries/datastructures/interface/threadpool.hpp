@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstddef>
+
+// A fixed set of worker threads for fork-join parallelism: run() hands out
+// the indices of a batch of tasks to the workers and the calling thread
+// alike, and returns once every task has finished. Tasks are claimed one at
+// a time from a shared counter, so uneven tasks balance themselves.
+//
+// Calls to run() from different threads take turns. A task must not call
+// run() on the pool it is running on.
+class ThreadPool
+{
+public:
+    // numThreads counts the thread calling run(), so a pool of one runs
+    // everything on the caller. Zero means one per hardware thread.
+    explicit ThreadPool( size_t numThreads = 0 );
+    ~ThreadPool();
+    
+    ThreadPool( const ThreadPool& ) = delete;
+    ThreadPool& operator=( const ThreadPool& ) = delete;
+    
+    // Call task( i ) for each i in [0, numTasks). If any task throws, the
+    // first exception is rethrown here once the rest have finished.
+    void run( size_t numTasks, const std::function<void(size_t)>& task );
+    
+    size_t size() const { return m_workers.size() + 1; }
+    
+    // Shared by the parallel algorithms when not given a pool of their own
+    static ThreadPool& shared();
+    
+private:
+    void work();
+    void execute();
+    
+private:
+    std::vector<std::thread>                m_workers;
+    std::mutex                              m_runMutex;
+    std::mutex                              m_mutex;
+    std::condition_variable                 m_wake;
+    std::condition_variable                 m_done;
+    const std::function<void(size_t)>*      m_task;
+    size_t                                  m_numTasks;
+    std::atomic<size_t>                     m_next;
+    size_t                                  m_busy;
+    size_t                                  m_generation;
+    bool                                    m_stop;
+    std::exception_ptr                      m_error;
+};
@@ -0,0 +1,36 @@
+#include "mappedfile.hpp"
+#include "checks.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+MappedFile::MappedFile( const std::string& path ) : m_data(NULL), m_size(0)
+{
+    int fd = ::open( path.c_str(), O_RDONLY );
+    throwing_assert( fd >= 0, "Failed to open " + path );
+    
+    struct stat st;
+    if ( ::fstat( fd, &st ) != 0 )
+    {
+        ::close( fd );
+        throwing_assert( false, "Failed to stat " + path );
+    }
+    m_size = static_cast<size_t>( st.st_size );
+    
+    // Mapping zero bytes is an error, and there is nothing to read anyway
+    if ( m_size > 0 )
+    {
+        void* mapped = ::mmap( NULL, m_size, PROT_READ, MAP_SHARED, fd, 0 );
+        ::close( fd );
+        throwing_assert( mapped != MAP_FAILED, "Failed to map " + path );
+        m_data = static_cast<const char*>( mapped );
+    }
+    else ::close( fd );
+}
+
+MappedFile::~MappedFile()
+{
+    if ( m_data != NULL ) ::munmap( const_cast<char*>( m_data ), m_size );
+}
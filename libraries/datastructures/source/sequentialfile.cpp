@@ -0,0 +1,131 @@
+#include "sequentialfile.hpp"
+#include "checks.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <cerrno>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+SequentialReader::SequentialReader( const std::string& path, size_t blockBytes ) :
+    m_path( path ),
+    m_fd( ::open( path.c_str(), O_RDONLY ) ),
+    m_size(0),
+    m_offset(0),
+    m_blockBytes( blockBytes )
+{
+    throwing_assert( m_fd >= 0, "Failed to open " + path );
+
+    struct stat st;
+    if ( ::fstat( m_fd, &st ) != 0 )
+    {
+        ::close( m_fd );
+        throwing_assert( false, "Failed to stat " + path );
+    }
+    m_size = static_cast<uint64_t>( st.st_size );
+
+    // Only a hint, so failure doesn't matter
+    ::posix_fadvise( m_fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+}
+
+SequentialReader::~SequentialReader()
+{
+    ::close( m_fd );
+}
+
+size_t SequentialReader::read( char* dest, size_t bytes )
+{
+    size_t done = 0;
+    while ( done < bytes )
+    {
+        ssize_t got = ::read( m_fd, dest + done, bytes - done );
+        if ( got < 0 && errno == EINTR ) continue;
+        throwing_assert( got >= 0, "Failed to read " + m_path );
+        if ( got == 0 ) break;
+        done += static_cast<size_t>( got );
+    }
+    m_offset += done;
+
+    if ( m_offset < m_size ) ::posix_fadvise( m_fd, m_offset, std::max( bytes, m_blockBytes ), POSIX_FADV_WILLNEED );
+    return done;
+}
+
+SequentialWriter::SequentialWriter( const std::string& path, size_t blockBytes ) :
+    m_path( path ),
+    m_fd( ::open( path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 ) ),
+    m_blockBytes( std::max<size_t>( blockBytes, 1 ) )
+{
+    throwing_assert( m_fd >= 0, "Failed to open " + path + " for writing" );
+    m_filling.reserve( m_blockBytes );
+    m_writing.reserve( m_blockBytes );
+}
+
+SequentialWriter::~SequentialWriter()
+{
+    if ( m_fd < 0 ) return;
+
+    try { close(); } catch ( std::exception& ) {}
+}
+
+void SequentialWriter::write( const char* data, size_t bytes )
+{
+    while ( bytes > 0 )
+    {
+        size_t n = std::min( bytes, m_blockBytes - m_filling.size() );
+        m_filling.insert( m_filling.end(), data, data + n );
+        data += n;
+        bytes -= n;
+        if ( m_filling.size() == m_blockBytes ) flush();
+    }
+}
+
+void SequentialWriter::close()
+{
+    // The file is closed even when the last writes failed
+    std::exception_ptr error;
+    try
+    {
+        flush();
+        wait();
+    }
+    catch ( ... )
+    {
+        error = std::current_exception();
+    }
+
+    int fd = m_fd;
+    m_fd = -1;
+    bool closed = ::close( fd ) == 0;
+    if ( error ) std::rethrow_exception( error );
+    throwing_assert( closed, "Failed to close " + m_path );
+}
+
+// Hand the filled block to the background thread, once it has finished with
+// the previous one
+void SequentialWriter::flush()
+{
+    wait();
+    m_writing.swap( m_filling );
+    m_filling.clear();
+    if ( m_writing.empty() ) return;
+
+    m_pending = std::async( std::launch::async, [this]()
+    {
+        size_t done = 0;
+        while ( done < m_writing.size() )
+        {
+            ssize_t put = ::write( m_fd, m_writing.data() + done, m_writing.size() - done );
+            if ( put < 0 && errno == EINTR ) continue;
+            throwing_assert( put > 0, "Failed to write " + m_path );
+            done += static_cast<size_t>( put );
+        }
+    } );
+}
+
+// Rethrows anything the background write threw
+void SequentialWriter::wait()
+{
+    if ( m_pending.valid() ) m_pending.get();
+}
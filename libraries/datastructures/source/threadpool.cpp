@@ -0,0 +1,98 @@
+#include "threadpool.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool( size_t numThreads ) :
+    m_task(NULL),
+    m_numTasks(0),
+    m_next(0),
+    m_busy(0),
+    m_generation(0),
+    m_stop(false)
+{
+    if ( numThreads == 0 ) numThreads = std::max( std::thread::hardware_concurrency(), 1U );
+    
+    for ( size_t i = 1; i < numThreads; ++i )
+    {
+        m_workers.push_back( std::thread( &ThreadPool::work, this ) );
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for ( auto& worker : m_workers ) worker.join();
+}
+
+void ThreadPool::run( size_t numTasks, const std::function<void(size_t)>& task )
+{
+    std::lock_guard<std::mutex> turn( m_runMutex );
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_task = &task;
+        m_numTasks = numTasks;
+        m_next = 0;
+        m_busy = m_workers.size();
+        m_error = std::exception_ptr();
+        m_generation++;
+    }
+    m_wake.notify_all();
+    
+    execute();
+    
+    std::exception_ptr error;
+    {
+        // Every worker checks in for every batch, so none can still be
+        // looking at this one when the next starts.
+        std::unique_lock<std::mutex> lock( m_mutex );
+        m_done.wait( lock, [this]() { return m_busy == 0; } );
+        m_task = NULL;
+        error = m_error;
+    }
+    if ( error ) std::rethrow_exception( error );
+}
+
+ThreadPool& ThreadPool::shared()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::work()
+{
+    size_t seen = 0;
+    while ( true )
+    {
+        {
+            std::unique_lock<std::mutex> lock( m_mutex );
+            m_wake.wait( lock, [this, seen]() { return m_stop || m_generation != seen; } );
+            if ( m_stop ) return;
+            seen = m_generation;
+        }
+        
+        execute();
+        
+        std::lock_guard<std::mutex> lock( m_mutex );
+        if ( --m_busy == 0 ) m_done.notify_one();
+    }
+}
+
+void ThreadPool::execute()
+{
+    for ( size_t i = m_next++; i < m_numTasks; i = m_next++ )
+    {
+        try
+        {
+            (*m_task)( i );
+        }
+        catch ( ... )
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            if ( !m_error ) m_error = std::current_exception();
+        }
+    }
+}
@@ -1,14 +1,39 @@
+// Build the tables with their instrumentation so statsTest can query it
+#define HASH_TABLE_STATS
+
+// Have every heap check its ordering after each change
+#define HEAP_CHECKED
+
 #include "hashtable.hpp"
 #include "openaddressinghashtable.hpp"
+#include "hashing.hpp"
+#include "mappedhashtable.hpp"
+#include "filteredhashtable.hpp"
 #include "mergesort.hpp"
 #include "quicksort.hpp"
+#include "samplesort.hpp"
+#include "adaptivemergesort.hpp"
+#include "radixsort.hpp"
+#include "selection.hpp"
+#include "sortingnetwork.hpp"
+#include "externalsort.hpp"
 #include "heap.hpp"
+#include "addressableheap.hpp"
 #include "bst.hpp"
 
 #include <set>
+#include <deque>
+#include <memory>
+#include <map>
 #include <random>
+#include <limits>
 #include <iostream>
 #include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <cstdio>
+#include <cmath>
 
 std::vector<int> randVec( int min, int max, size_t count )
 {
@@ -179,6 +204,641 @@ void openAddressingHashTest()
     
 }
 
+// Keeps keys that are equal modulo a power of two in the same home bucket,
+// so tests can build clusters on purpose
+struct IdentityHash
+{
+    size_t operator()( int k ) const { return static_cast<size_t>( k ); }
+};
+
+void openAddressingChurnTest()
+{
+    // Keys that share home buckets and wrap around the end of the control
+    // array, with erases from the middle of interleaved runs.
+    OpenAddressingHashTable<int, std::string, IdentityHash> h(64);
+    std::map<int, std::string> truth;
+    
+    auto ops = randVec( 0, 255, 4000 );
+    for ( size_t i = 0; i < ops.size(); ++i )
+    {
+        int key = (ops[i] % 48) * 64 + (ops[i] % 5) + 60;
+        if ( truth.count( key ) )
+        {
+            CHECK( h.erase( key ) );
+            truth.erase( key );
+        }
+        else if ( truth.size() < 48 )
+        {
+            h.insert( std::make_pair( key, std::to_string( key ) ) );
+            truth[key] = std::to_string( key );
+        }
+        CHECK_EQUAL( h.size(), truth.size() );
+    }
+    
+    for ( int key = 0; key < 48 * 64 + 70; ++key )
+    {
+        CHECK_EQUAL( h.find( key ), truth.count( key ) == 1 );
+        if ( truth.count( key ) ) CHECK_EQUAL( h.get( key ), truth[key] );
+    }
+}
+
+void inlineRowsTest()
+{
+    // A high load factor keeps chains long enough to spill into the arena,
+    // and erases from both the inline slots and the overflow chains.
+    HashTable<int, std::string, IdentityHash, PowerOfTwoReduction, InlineRows<int, std::string, 2>> h( 16, 1 );
+    h.max_load_factor( 6.0f );
+    h.incremental_rehash( 2 );
+    std::map<int, std::string> truth;
+    
+    auto ops = randVec( 0, 511, 20000 );
+    for ( size_t i = 0; i < ops.size(); ++i )
+    {
+        int key = ops[i];
+        if ( truth.count( key ) )
+        {
+            CHECK_EQUAL( h.get( key ), truth[key] );
+            CHECK( h.erase( key ) );
+            truth.erase( key );
+        }
+        else if ( truth.size() < 300 )
+        {
+            h.insert( std::make_pair( key, std::to_string( key ) ) );
+            truth[key] = std::to_string( key );
+        }
+        CHECK_EQUAL( static_cast<size_t>( h.size() ), truth.size() );
+    }
+    CHECK( h.load_factor() > 2.0f );
+    
+    for ( int key = 0; key < 512; ++key )
+    {
+        CHECK_EQUAL( h.find( key ), truth.count( key ) == 1 );
+        if ( truth.count( key ) ) CHECK_EQUAL( h.get( key ), truth[key] );
+    }
+    
+    h.max_load_factor( 1.0f );
+    for ( auto& kv : truth ) CHECK_EQUAL( h.get( kv.first ), kv.second );
+}
+
+void hashGrowthTest()
+{
+    {
+        HashTable<int, int> h( 4, 2 );
+        h.max_load_factor( 2.0f );
+        for ( int i = 0; i < 10000; ++i ) h.insert( std::make_pair( i, i * 2 ) );
+        
+        CHECK_EQUAL( h.size(), 10000 );
+        CHECK( h.load_factor() <= 2.0f );
+        for ( int i = 0; i < 10000; ++i ) CHECK( h.find( i ) );
+        CHECK( !h.find( 10000 ) );
+        
+        for ( int i = 0; i < 9900; ++i ) CHECK( h.erase( i ) );
+        h.shrink_to_fit();
+        CHECK_EQUAL( h.bucket_count(), 64U );
+        for ( int i = 9900; i < 10000; ++i ) CHECK( h.find( i ) );
+        
+        h.reserve( 1000 );
+        CHECK_EQUAL( h.bucket_count(), 512U );
+    }
+    
+    {
+        // Used to spin forever once the initial capacity was exhausted
+        OpenAddressingHashTable<int, std::string> h( 16 );
+        for ( int i = 0; i < 10000; ++i ) h.insert( std::make_pair( i, std::to_string( i ) ) );
+        
+        CHECK_EQUAL( h.size(), 10000U );
+        CHECK( h.load_factor() <= h.max_load_factor() );
+        for ( int i = 0; i < 10000; ++i ) CHECK_EQUAL( h.get( i ), std::to_string( i ) );
+        CHECK( !h.find( 10000 ) );
+        
+        for ( int i = 0; i < 9990; ++i ) CHECK( h.erase( i ) );
+        h.shrink_to_fit();
+        CHECK_EQUAL( h.capacity(), 16U );
+        for ( int i = 9990; i < 10000; ++i ) CHECK_EQUAL( h.get( i ), std::to_string( i ) );
+        
+        h.max_load_factor( 0.5f );
+        h.reserve( 1000 );
+        CHECK_EQUAL( h.capacity(), 2048U );
+        CHECK_EQUAL( h.size(), 10U );
+        
+        // Churn at a fixed size must not keep growing the table
+        for ( int i = 0; i < 100000; ++i )
+        {
+            h.insert( std::make_pair( 20000 + i, std::string("x") ) );
+            CHECK( h.erase( 20000 + i ) );
+        }
+        CHECK_EQUAL( h.capacity(), 2048U );
+    }
+}
+
+void incrementalRehashTest()
+{
+    // Check every key after every operation, as the old and new arrays
+    // coexist for a while after each growth.
+    auto ops = randVec( 0, 2999, 6000 );
+    
+    {
+        HashTable<int, int> h( 4, 2 );
+        h.incremental_rehash( 2 );
+        std::set<int> truth;
+        for ( int key : ops )
+        {
+            if ( truth.count( key ) ) CHECK( h.erase( key ) );
+            else h.insert( std::make_pair( key, key ) );
+            if ( !truth.insert( key ).second ) truth.erase( key );
+            
+            CHECK_EQUAL( h.size(), (int) truth.size() );
+            if ( key % 50 == 0 )
+            {
+                for ( int k = 0; k < 3000; ++k ) CHECK_EQUAL( h.find( k ), truth.count( k ) == 1 );
+            }
+        }
+        h.incremental_rehash( 0 );
+        for ( int k = 0; k < 3000; ++k ) CHECK_EQUAL( h.find( k ), truth.count( k ) == 1 );
+    }
+    
+    {
+        OpenAddressingHashTable<int, std::string> h( 16 );
+        h.incremental_rehash( 4 );
+        std::set<int> truth;
+        for ( int key : ops )
+        {
+            if ( truth.count( key ) ) CHECK( h.erase( key ) );
+            else h.insert( std::make_pair( key, std::to_string( key ) ) );
+            if ( !truth.insert( key ).second ) truth.erase( key );
+            
+            CHECK_EQUAL( h.size(), truth.size() );
+            CHECK( h.load_factor() < 1.0f );
+            if ( key % 50 == 0 )
+            {
+                for ( int k = 0; k < 3000; ++k ) CHECK_EQUAL( h.find( k ), truth.count( k ) == 1 );
+            }
+        }
+        for ( int k : truth ) CHECK_EQUAL( h.get( k ), std::to_string( k ) );
+        
+        h.shrink_to_fit();
+        for ( int k = 0; k < 3000; ++k ) CHECK_EQUAL( h.find( k ), truth.count( k ) == 1 );
+    }
+
+    {
+        // Reserving while the next generation is only partly prepared
+        // replaces it with one of the reserved size
+        HashTable<int, int> h( 64, 1 );
+        OpenAddressingHashTable<int, int> oh( 64 );
+        h.incremental_rehash( 1 );
+        oh.incremental_rehash( 1 );
+        for ( int k = 0; k < 3000; ++k )
+        {
+            if ( k == 52 )
+            {
+                h.reserve( 1000 );
+                oh.reserve( 1000 );
+                CHECK_EQUAL( h.bucket_count(), 1024U );
+                CHECK_EQUAL( oh.capacity(), 2048U );
+            }
+            h.insert( std::make_pair( k, -k ) );
+            oh.insert( std::make_pair( k, -k ) );
+        }
+        for ( int k = 0; k < 3000; ++k )
+        {
+            CHECK_EQUAL( h.get( k ), -k );
+            CHECK_EQUAL( oh.get( k ), -k );
+        }
+    }
+
+    {
+        // One slot per operation is too slow to keep up at a high load
+        // factor, so the step grows to finish each rehash before the next
+        // one, which would otherwise throw
+        HashTable<int, int> h( 4, 4 );
+        OpenAddressingHashTable<int, int> oh( 16 );
+        h.max_load_factor( 4.0f );
+        oh.max_load_factor( 0.95f );
+        h.incremental_rehash( 1 );
+        oh.incremental_rehash( 1 );
+        for ( int k = 0; k < 20000; ++k )
+        {
+            h.insert( std::make_pair( k, k ) );
+            oh.insert( std::make_pair( k, k ) );
+        }
+        CHECK_EQUAL( h.size(), 20000 );
+        CHECK_EQUAL( oh.size(), 20000U );
+        for ( int k = 0; k < 20000; ++k )
+        {
+            CHECK_EQUAL( h.get( k ), k );
+            CHECK_EQUAL( oh.get( k ), k );
+        }
+    }
+}
+
+void robinHoodTest()
+{
+    // Run at a high load factor with long interleaved clusters: keys k and
+    // k + capacity share a home, and neighbouring homes overlap their runs.
+    OpenAddressingHashTable<int, int, IdentityHash> h( 1024 );
+    h.max_load_factor( 0.95f );
+    h.reserve( 900 );
+    size_t capacity = h.capacity();
+    
+    std::set<int> truth;
+    auto ops = randVec( 0, 1199, 20000 );
+    for ( size_t i = 0; i < ops.size(); ++i )
+    {
+        int key = (ops[i] % 40) + (ops[i] / 40) * static_cast<int>( capacity );
+        if ( truth.count( key ) )
+        {
+            CHECK( h.erase( key ) );
+            truth.erase( key );
+        }
+        else if ( truth.size() < 900 )
+        {
+            h.insert( std::make_pair( key, -key ) );
+            truth.insert( key );
+        }
+        
+        CHECK_EQUAL( h.size(), truth.size() );
+        CHECK_EQUAL( h.find( key ), truth.count( key ) == 1 );
+    }
+    CHECK_EQUAL( h.capacity(), capacity );
+    
+    for ( int i = 0; i < 1200; ++i )
+    {
+        int key = (i % 40) + (i / 40) * static_cast<int>( capacity );
+        CHECK_EQUAL( h.find( key ), truth.count( key ) == 1 );
+        CHECK( !h.find( key + 40 ) );
+        if ( truth.count( key ) ) CHECK_EQUAL( h.get( key ), -key );
+    }
+}
+
+// Counts copies so the in-place APIs can be checked to not make any
+struct CopyCounted
+{
+    CopyCounted() : m_value(0) {}
+    explicit CopyCounted( int value ) : m_value(value) {}
+    CopyCounted( const CopyCounted& other ) : m_value(other.m_value) { copies++; }
+    CopyCounted( CopyCounted&& other ) noexcept : m_value(other.m_value) {}
+    CopyCounted& operator=( const CopyCounted& other ) { m_value = other.m_value; copies++; return *this; }
+    CopyCounted& operator=( CopyCounted&& other ) noexcept { m_value = other.m_value; return *this; }
+    
+    int m_value;
+    static int copies;
+};
+
+int CopyCounted::copies = 0;
+
+template<typename Table>
+void inPlaceApiTest( Table& h )
+{
+    CopyCounted::copies = 0;
+    
+    auto r = h.try_emplace( std::string("alpha"), 1 );
+    CHECK( r.second );
+    CHECK_EQUAL( r.first->m_value, 1 );
+    
+    // Present already: no insert, and the existing value is untouched
+    r = h.try_emplace( std::string("alpha"), 2 );
+    CHECK( !r.second );
+    CHECK_EQUAL( r.first->m_value, 1 );
+    
+    r = h.emplace( std::string("beta"), CopyCounted(3) );
+    CHECK( r.second );
+    CHECK( !h.emplace( std::string("beta"), CopyCounted(4) ).second );
+    
+    h[std::string("gamma")].m_value = 5;
+    h[std::string("gamma")].m_value += 1;
+    
+    h.insert( std::make_pair( std::string("delta"), CopyCounted(7) ) );
+    
+    // Heterogeneous lookups with C strings build no temporary std::string
+    CHECK( h.find( "alpha" ) );
+    CHECK( !h.find( "epsilon" ) );
+    CHECK( h.findPtr( "epsilon" ) == NULL );
+    CHECK_EQUAL( h.findPtr( "beta" )->m_value, 3 );
+    CHECK_EQUAL( h.get( "gamma" ).m_value, 6 );
+    CHECK_EQUAL( h.get( std::string("delta") ).m_value, 7 );
+    
+    h.findPtr( "delta" )->m_value = 8;
+    CHECK_EQUAL( h.get( "delta" ).m_value, 8 );
+    
+    CHECK_EQUAL( CopyCounted::copies, 0 );
+    
+    CHECK( h.erase( "alpha" ) );
+    CHECK( !h.find( "alpha" ) );
+    CHECK_EQUAL( static_cast<size_t>( h.size() ), 3U );
+    
+    // Plenty more to push both tables through a few rehashes
+    for ( int i = 0; i < 1000; ++i ) CHECK( h.try_emplace( std::to_string( i ), i ).second );
+    for ( int i = 0; i < 1000; ++i ) CHECK_EQUAL( h.get( std::to_string( i ).c_str() ).m_value, i );
+    CHECK_EQUAL( h.get( "delta" ).m_value, 8 );
+}
+
+void hashInPlaceApiTest()
+{
+    {
+        HashTable<std::string, CopyCounted, StringHash> h( 4, 1 );
+        inPlaceApiTest( h );
+    }
+    {
+        HashTable<std::string, CopyCounted, StringHash, PowerOfTwoReduction, InlineRows<std::string, CopyCounted, 2>> h( 4, 1 );
+        inPlaceApiTest( h );
+    }
+    {
+        OpenAddressingHashTable<std::string, CopyCounted, StringHash> h( 16 );
+        inPlaceApiTest( h );
+    }
+    {
+        OpenAddressingHashTable<std::string, CopyCounted, StringHash> h( 16 );
+        h.incremental_rehash( 3 );
+        inPlaceApiTest( h );
+    }
+    {
+        // Finding the key moves nothing, even with the tables full enough
+        // that the next insert grows them
+        HashTable<int, int> h( 16, 1 );
+        OpenAddressingHashTable<int, int> oh( 16 );
+        for ( int k = 0; k < 16; ++k ) h.insert( std::make_pair( k, k ) );
+        for ( int k = 0; k < 14; ++k ) oh.insert( std::make_pair( k, k ) );
+
+        int* p = h.findPtr( 3 );
+        int* op = oh.findPtr( 3 );
+        CHECK( h.try_emplace( 3, 0 ).first == p );
+        CHECK( oh.try_emplace( 3, 0 ).first == op );
+        CHECK( &h[3] == p );
+        CHECK( &oh[3] == op );
+        CHECK_EQUAL( h.bucket_count(), 16U );
+        CHECK_EQUAL( oh.capacity(), 16U );
+
+        CHECK( h.try_emplace( 16, 16 ).second );
+        CHECK( oh.try_emplace( 14, 14 ).second );
+        CHECK_EQUAL( h.bucket_count(), 32U );
+        CHECK_EQUAL( oh.capacity(), 32U );
+    }
+}
+
+void batchLookupTest()
+{
+    auto keys = randVec( 0, 5000, 1000 );
+    
+    HashTable<int, int> h( 16, 2 );
+    OpenAddressingHashTable<int, int> oh( 16 );
+    oh.incremental_rehash( 8 );
+    for ( int i = 0; i < 3000; ++i )
+    {
+        h.insert( std::make_pair( i, -i ) );
+        oh.insert( std::make_pair( i, -i ) );
+    }
+    
+    std::vector<int*> found;
+    h.find_batch( keys, found );
+    std::vector<const int*> ofound;
+    oh.find_batch( keys, ofound );
+    
+    CHECK_EQUAL( found.size(), keys.size() );
+    CHECK_EQUAL( ofound.size(), keys.size() );
+    for ( size_t i = 0; i < keys.size(); ++i )
+    {
+        CHECK_EQUAL( found[i] != NULL, keys[i] < 3000 );
+        CHECK_EQUAL( ofound[i] != NULL, keys[i] < 3000 );
+        if ( keys[i] < 3000 )
+        {
+            CHECK_EQUAL( *found[i], -keys[i] );
+            CHECK_EQUAL( *ofound[i], -keys[i] );
+        }
+    }
+    
+    std::vector<int> present = { 5, 2999, 0, 17 };
+    std::vector<int> values;
+    h.get_batch( present, values );
+    CHECK_EQUAL( values.size(), 4U );
+    CHECK_EQUAL( values[1], -2999 );
+    oh.get_batch( present, values );
+    CHECK_EQUAL( values.size(), 4U );
+    CHECK_EQUAL( values[3], -17 );
+    
+    bool threw = false;
+    try { oh.get_batch( keys, values ); } catch ( std::runtime_error& ) { threw = true; }
+    CHECK( threw );
+}
+
+template<typename Table>
+void sequentialKeysTest( Table& h )
+{
+    for ( int i = 0; i < 5000; ++i ) h.insert( std::make_pair( i, i + 1 ) );
+    for ( int i = 0; i < 5000; i += 2 ) CHECK( h.erase( i ) );
+    for ( int i = 0; i < 5000; ++i ) CHECK_EQUAL( h.find( i ), i % 2 == 1 );
+    for ( int i = 1; i < 5000; i += 2 ) CHECK_EQUAL( h.get( i ), i + 1 );
+}
+
+void reductionPolicyTest()
+{
+    CHECK_EQUAL( PowerOfTwoReduction::bucketCount( 1000 ), 1024U );
+    CHECK_EQUAL( PrimeReduction::bucketCount( 1000 ), 1543U );
+    CHECK_EQUAL( FastRangeReduction::bucketCount( 1000 ), 1000U );
+    
+    {
+        HashTable<int, int> h( 10, 1 );
+        CHECK_EQUAL( h.bucket_count(), 16U );
+        sequentialKeysTest( h );
+    }
+    {
+        HashTable<int, int, DefaultHash<int>, PrimeReduction> h( 10, 1 );
+        CHECK_EQUAL( h.bucket_count(), 11U );
+        sequentialKeysTest( h );
+        CHECK_EQUAL( h.bucket_count(), 6151U );
+    }
+    {
+        HashTable<int, int, DefaultHash<int>, FastRangeReduction> h( 10, 1 );
+        sequentialKeysTest( h );
+    }
+    {
+        OpenAddressingHashTable<int, int> h( 100 );
+        CHECK_EQUAL( h.capacity(), 128U );
+        sequentialKeysTest( h );
+    }
+    {
+        // std::hash is the identity here, which is what prime moduli are for
+        OpenAddressingHashTable<int, int, std::hash<int>, PrimeReduction> h( 100 );
+        CHECK_EQUAL( h.capacity(), 193U );
+        sequentialKeysTest( h );
+    }
+    {
+        OpenAddressingHashTable<int, int, DefaultHash<int>, FastRangeReduction> h( 100 );
+        h.incremental_rehash( 5 );
+        sequentialKeysTest( h );
+    }
+}
+
+void snapshotTest()
+{
+    const char* path = "hashsnapshot_test.bin";
+    
+    // Saved mid-rehash, which has to be finished before writing
+    OpenAddressingHashTable<int, double> h( 16 );
+    h.incremental_rehash( 2 );
+    for ( int i = 0; i < 5000; ++i ) h.insert( std::make_pair( i * 7, i * 0.5 ) );
+    for ( int i = 0; i < 5000; i += 3 ) CHECK( h.erase( i * 7 ) );
+    h.save( path );
+    
+    {
+        MappedHashTable<int, double> m( path );
+        CHECK_EQUAL( m.size(), h.size() );
+        CHECK_EQUAL( m.capacity(), h.capacity() );
+        for ( int k = 0; k < 5000 * 7; ++k )
+        {
+            bool present = k % 7 == 0 && (k / 7) % 3 != 0;
+            CHECK_EQUAL( m.find( k ), present );
+            if ( present ) CHECK_EQUAL( m.get( k ), (k / 7) * 0.5 );
+            else CHECK( m.findPtr( k ) == NULL );
+        }
+    }
+    
+    // The snapshot records the key and value sizes it was written with
+    bool threw = false;
+    try { MappedHashTable<int, int> wrong( path ); } catch ( std::runtime_error& ) { threw = true; }
+    CHECK( threw );
+    
+    {
+        std::ofstream out( path, std::ios::binary | std::ios::trunc );
+        out << "not a snapshot";
+    }
+    threw = false;
+    try { MappedHashTable<int, double> garbage( path ); } catch ( std::runtime_error& ) { threw = true; }
+    CHECK( threw );
+    
+    std::remove( path );
+}
+
+void statsTest()
+{
+    {
+        // Three keys sharing a home slot, then a run of neighbours behind them
+        OpenAddressingHashTable<int, int, IdentityHash> h( 64 );
+        for ( int k : { 3, 67, 131, 4, 5 } ) h.insert( std::make_pair( k, k ) );
+        
+        auto s = h.stats();
+        CHECK_EQUAL( s.size, 5U );
+        CHECK_EQUAL( s.capacity, 64U );
+        CHECK_EQUAL( s.longestCluster, 5U );
+        CHECK_EQUAL( s.probeLengths.size(), 3U );
+        CHECK_EQUAL( s.probeLengths[0], 1U );
+        CHECK_EQUAL( s.probeLengths[1], 1U );
+        CHECK_EQUAL( s.probeLengths[2], 3U );
+        CHECK_EQUAL( s.rehashes, 0U );
+        
+        // Everything behind the home slot shifts back
+        CHECK( h.erase( 3 ) );
+        s = h.stats();
+        CHECK_EQUAL( s.eraseShifts, 4U );
+        CHECK_EQUAL( s.longestCluster, 4U );
+        
+        for ( int k = 0; k < 200; ++k ) h.insert( std::make_pair( 1000 + k, k ) );
+        CHECK_EQUAL( h.stats().rehashes, 2U );
+    }
+    {
+        HashTable<int, int, IdentityHash> h( 16, 1 );
+        for ( int k : { 0, 16, 32, 5 } ) h.insert( std::make_pair( k, k ) );
+        
+        auto s = h.stats();
+        CHECK_EQUAL( s.size, 4U );
+        CHECK_EQUAL( s.bucketCount, 16U );
+        CHECK_EQUAL( s.longestChain, 3U );
+        CHECK_EQUAL( s.chainLengths[0], 14U );
+        CHECK_EQUAL( s.chainLengths[1], 1U );
+        CHECK_EQUAL( s.chainLengths[3], 1U );
+        
+        for ( int k = 0; k < 100; ++k ) h.insert( std::make_pair( 1000 + k, k ) );
+        CHECK_EQUAL( h.stats().rehashes, 3U );
+    }
+}
+
+template<typename Filter>
+void filterTest( Filter& f, size_t count, double maxFalsePositives )
+{
+    for ( size_t i = 0; i < count; ++i ) CHECK( f.insert( mix64( i ) ) );
+    for ( size_t i = 0; i < count; ++i ) CHECK( f.mayContain( mix64( i ) ) );
+    
+    size_t falsePositives = 0;
+    for ( size_t i = count; i < count * 11; ++i ) falsePositives += f.mayContain( mix64( i ) );
+    CHECK( falsePositives < count * 10 * maxFalsePositives );
+}
+
+template<typename Table>
+void filteredTableTest( Table& h )
+{
+    std::set<int> truth;
+    auto ops = randVec( 0, 9999, 30000 );
+    for ( size_t i = 0; i < ops.size(); ++i )
+    {
+        int key = ops[i];
+        if ( truth.count( key ) )
+        {
+            CHECK_EQUAL( h.get( key ), -key );
+            CHECK( h.erase( key ) );
+            truth.erase( key );
+        }
+        else
+        {
+            CHECK( !h.erase( key ) );
+            CHECK( h.try_emplace( key, -key ).second );
+            truth.insert( key );
+        }
+        CHECK_EQUAL( h.size(), truth.size() );
+    }
+    
+    for ( int key = 0; key < 20000; ++key )
+    {
+        CHECK_EQUAL( h.find( key ), truth.count( key ) == 1 );
+        CHECK_EQUAL( h.findPtr( key ) != NULL, truth.count( key ) == 1 );
+    }
+}
+
+void filterTest()
+{
+    {
+        BlockedBloomFilter f( 10000 );
+        filterTest( f, 10000, 0.02 );
+        CHECK( !f.erase( mix64( 0 ) ) );
+    }
+    {
+        CuckooFilter f( 10000 );
+        filterTest( f, 10000, 0.01 );
+        
+        for ( size_t i = 0; i < 10000; i += 2 ) CHECK( f.erase( mix64( i ) ) );
+        for ( size_t i = 1; i < 10000; i += 2 ) CHECK( f.mayContain( mix64( i ) ) );
+    }
+    {
+        // Overfill: inserts start failing, but nothing that went in is lost
+        CuckooFilter f( 1000 );
+        size_t inserted = 0;
+        while ( f.insert( mix64( inserted ) ) ) inserted++;
+        CHECK( f.full() );
+        CHECK( inserted >= 1000 );
+        for ( size_t i = 0; i < inserted; ++i ) CHECK( f.mayContain( mix64( i ) ) );
+    }
+    {
+        FilteredHashTable<HashTable<int, int>> h( 16, 1 );
+        filteredTableTest( h );
+    }
+    {
+        FilteredHashTable<OpenAddressingHashTable<int, int, IdentityHash>, CuckooFilter> h( 16 );
+        filteredTableTest( h );
+    }
+    {
+        // Keys moved in through the wrapper, past a filter rebuild
+        FilteredHashTable<HashTable<std::string, int>> h( 16, 1 );
+        for ( int i = 0; i < 3000; ++i )
+        {
+            std::string key = "key" + std::to_string( i );
+            CHECK( h.try_emplace( std::move( key ), i ).second );
+            CHECK( key.empty() );
+        }
+        std::string again = "key7";
+        CHECK( !h.try_emplace( std::move( again ), 0 ).second );
+        for ( int i = 0; i < 3000; ++i ) CHECK_EQUAL( h.get( "key" + std::to_string( i ) ), i );
+        CHECK( !h.find( std::string( "key3000" ) ) );
+    }
+}
+
 void mergeSortTest()
 {
     std::vector<int> input = { 4, 1, 2, 3, 6, 1, 5, 3, 7, 6 };
@@ -194,6 +854,115 @@ void mergeSortTest()
     }
 }
 
+// Ordered on key alone, so that a stable sort must keep equal keys in
+// their original order
+struct Keyed
+{
+    int     key;
+    size_t  order;
+    
+    bool operator<( const Keyed& other ) const { return key < other.key; }
+};
+
+void threadPoolTest()
+{
+    ThreadPool pool( 4 );
+    CHECK_EQUAL( pool.size(), 4U );
+    
+    std::vector<int> counts( 1000, 0 );
+    for ( int round = 0; round < 20; ++round )
+    {
+        pool.run( counts.size(), [&counts]( size_t i ) { counts[i]++; } );
+    }
+    for ( int c : counts ) CHECK_EQUAL( c, 20 );
+    
+    bool threw = false;
+    try { pool.run( 100, []( size_t i ) { if ( i == 37 ) throw std::runtime_error( "task failed" ); } ); }
+    catch ( std::runtime_error& ) { threw = true; }
+    CHECK( threw );
+    
+    // Still usable afterwards
+    pool.run( counts.size(), [&counts]( size_t i ) { counts[i]--; } );
+    CHECK_EQUAL( counts[999], 19 );
+}
+
+void parallelMergeSortTest()
+{
+    for ( size_t threads : { 1, 2, 3, 8 } )
+    {
+        ThreadPool pool( threads );
+        for ( size_t n : { 0, 1, 1000, 50000, 200001 } )
+        {
+            auto input = randVec( -1000, 1000, n );
+            auto expected = input;
+            std::sort( expected.begin(), expected.end() );
+            
+            mergeSort( input, pool );
+            CHECK( input == expected );
+        }
+    }
+    
+    ThreadPool pool( 5 );
+    auto keys = randVec( 0, 50, 100000 );
+    std::vector<Keyed> records;
+    for ( size_t i = 0; i < keys.size(); ++i ) records.push_back( Keyed { keys[i], i } );
+    mergeSort( records, pool );
+    for ( size_t i = 1; i < records.size(); ++i )
+    {
+        CHECK( records[i - 1].key <= records[i].key );
+        if ( records[i - 1].key == records[i].key ) CHECK( records[i - 1].order < records[i].order );
+    }
+}
+
+void sortApiTest()
+{
+    // A sub-range of a deque, in descending order
+    auto values = randVec( 0, 100, 5000 );
+    std::deque<int> d( values.begin(), values.end() );
+    mergeSort( d.begin() + 100, d.end() - 100, std::greater<int>() );
+    CHECK( std::is_sorted( d.begin() + 100, d.end() - 100, std::greater<int>() ) );
+    CHECK( std::equal( d.begin(), d.begin() + 100, values.begin() ) );
+    CHECK( std::equal( d.end() - 100, d.end(), values.end() - 100 ) );
+    
+    // By a projection, with equal keys left in their original order
+    auto keys = randVec( 0, 20, 3000 );
+    std::vector<Keyed> records;
+    for ( size_t i = 0; i < keys.size(); ++i ) records.push_back( Keyed { keys[i], keys.size() - i } );
+    mergeSort( records.begin(), records.end(), byKey( []( const Keyed& r ) { return -r.key; } ) );
+    for ( size_t i = 1; i < records.size(); ++i )
+    {
+        CHECK( records[i - 1].key >= records[i].key );
+        if ( records[i - 1].key == records[i].key ) CHECK( records[i - 1].order > records[i].order );
+    }
+    
+    // Move-only elements, which both sorts must move rather than copy
+    std::vector<std::unique_ptr<int>> owned;
+    for ( int v : values ) owned.push_back( std::unique_ptr<int>( new int( v ) ) );
+    auto deref = byKey( []( const std::unique_ptr<int>& p ) { return *p; } );
+    mergeSort( owned, deref );
+    CHECK( std::is_sorted( owned.begin(), owned.end(), deref ) );
+    std::reverse( owned.begin(), owned.end() );
+    mergeSort( owned.begin(), owned.begin() + 1234, deref );
+    CHECK( std::is_sorted( owned.begin(), owned.begin() + 1234, deref ) );
+    
+    std::vector<std::string> words;
+    for ( int v : values ) words.push_back( std::to_string( v ) );
+    auto expected = words;
+    std::sort( expected.begin(), expected.end() );
+    mergeSort( words );
+    CHECK( words == expected );
+    
+    ThreadPool pool( 3 );
+    std::vector<std::string> many;
+    for ( int v : randVec( 0, 1000000, 100000 ) ) many.push_back( std::to_string( v ) );
+    mergeSort( many.begin(), many.end(), pool, std::greater<std::string>() );
+    CHECK( std::is_sorted( many.begin(), many.end(), std::greater<std::string>() ) );
+    
+    std::vector<int> small = { 3, 1, 2 };
+    quickSort( small.begin(), small.end(), std::greater<int>() );
+    CHECK( std::is_sorted( small.begin(), small.end(), std::greater<int>() ) );
+}
+
 void quickSortTest()
 {
     std::vector<int> input = { 4, 1, 2, 3, 6, 1, 5, 3, 7, 6 };
@@ -209,6 +978,426 @@ void quickSortTest()
     }
 }
 
+// Inputs that take a naive quicksort quadratic, at sizes either side of the
+// insertion sort and ninther cut-offs
+void quickSortAdversarialTest()
+{
+    for ( size_t n : { 0, 1, 2, 3, 16, 17, 100, 129, 5000, 100000 } )
+    {
+        auto random = randVec( 0, 1000000, n );
+        auto fewUnique = randVec( 0, 3, n );
+        std::vector<int> sorted, reversed, organPipe, equal( n, 7 );
+        for ( size_t i = 0; i < n; ++i )
+        {
+            sorted.push_back( int(i) );
+            reversed.push_back( int(n - i) );
+            organPipe.push_back( int(std::min( i, n - i )) );
+        }
+
+        for ( auto input : { random, fewUnique, sorted, reversed, organPipe, equal } )
+        {
+            auto expected = input;
+            std::sort( expected.begin(), expected.end() );
+
+            // n log2 n comparisons or so, rather than n^2 / 2
+            size_t comparisons = 0;
+            quickSort( input.begin(), input.end(), [&comparisons]( int a, int b ) { comparisons++; return a < b; } );
+            CHECK( input == expected );
+            CHECK( comparisons <= 4 * n * 17 + 100 );
+        }
+    }
+}
+
+void sampleSortTest()
+{
+    for ( size_t threads : { 1, 2, 3, 8 } )
+    {
+        ThreadPool pool( threads );
+        for ( size_t n : { 0, 1, 1000, 70000, 300001 } )
+        {
+            auto input = randVec( -1000000, 1000000, n );
+            auto expected = input;
+            std::sort( expected.begin(), expected.end() );
+
+            sampleSort( input, pool );
+            CHECK( input == expected );
+        }
+    }
+
+    // Few distinct values, so most splitters repeat, and a deque sub-range
+    ThreadPool pool( 4 );
+    for ( int maxValue : { 0, 1, 20 } )
+    {
+        auto values = randVec( 0, maxValue, 200000 );
+        std::deque<int> d( values.begin(), values.end() );
+        sampleSort( d.begin() + 10, d.end(), pool );
+        CHECK( std::is_sorted( d.begin() + 10, d.end() ) );
+        CHECK( std::equal( d.begin(), d.begin() + 10, values.begin() ) );
+        CHECK( std::count( d.begin(), d.end(), maxValue ) == std::count( values.begin(), values.end(), maxValue ) );
+    }
+
+    std::vector<std::string> strings;
+    for ( int v : randVec( 0, 1000000, 100000 ) ) strings.push_back( std::to_string( v ) );
+    auto expected = strings;
+    std::sort( expected.begin(), expected.end(), std::greater<std::string>() );
+    sampleSort( strings.begin(), strings.end(), pool, std::greater<std::string>() );
+    CHECK( strings == expected );
+}
+
+void adaptiveMergeSortTest()
+{
+    auto countingLess = []( size_t& comparisons )
+    {
+        return [&comparisons]( int a, int b ) { comparisons++; return a < b; };
+    };
+
+    // Sorted and strictly descending input is a single run
+    for ( size_t n : { 0, 1, 2, 63, 64, 100000 } )
+    {
+        std::vector<int> ascending, descending;
+        for ( size_t i = 0; i < n; ++i )
+        {
+            ascending.push_back( int(i) );
+            descending.push_back( int(n - i) );
+        }
+
+        size_t comparisons = 0;
+        auto expected = ascending;
+        adaptiveMergeSort( ascending, countingLess( comparisons ) );
+        CHECK( ascending == expected );
+        CHECK( comparisons <= n );
+
+        comparisons = 0;
+        expected = descending;
+        std::sort( expected.begin(), expected.end() );
+        adaptiveMergeSort( descending, countingLess( comparisons ) );
+        CHECK( descending == expected );
+        CHECK( comparisons <= n );
+    }
+
+    // Sorted batches end to end, which galloping merges in far fewer than
+    // n log2 n comparisons
+    auto values = randVec( 0, 1000000, 100000 );
+    for ( size_t batch = 0; batch < values.size(); batch += 12500 )
+    {
+        std::sort( values.begin() + batch, values.begin() + std::min( batch + 12500, values.size() ) );
+    }
+    auto expected = values;
+    std::sort( expected.begin(), expected.end() );
+    size_t comparisons = 0;
+    adaptiveMergeSort( values, countingLess( comparisons ) );
+    CHECK( values == expected );
+    CHECK( comparisons < values.size() * 6 );
+
+    // Random input, a few unique keys for stability, and move-only elements
+    auto keys = randVec( 0, 20, 50000 );
+    std::vector<Keyed> records;
+    for ( size_t i = 0; i < keys.size(); ++i ) records.push_back( Keyed { keys[i], i } );
+    adaptiveMergeSort( records.begin(), records.end() );
+    for ( size_t i = 1; i < records.size(); ++i )
+    {
+        CHECK( records[i - 1].key <= records[i].key );
+        if ( records[i - 1].key == records[i].key ) CHECK( records[i - 1].order < records[i].order );
+    }
+
+    auto random = randVec( -1000, 1000, 30000 );
+    std::vector<std::unique_ptr<int>> owned;
+    for ( int v : random ) owned.push_back( std::unique_ptr<int>( new int( v ) ) );
+    auto deref = byKey( []( const std::unique_ptr<int>& p ) { return *p; } );
+    adaptiveMergeSort( owned, deref );
+    std::sort( random.begin(), random.end() );
+    for ( size_t i = 0; i < random.size(); ++i ) CHECK_EQUAL( *owned[i], random[i] );
+}
+
+void radixSortTest()
+{
+    // Signed ints either side of zero, in a deque sub-range
+    auto values = randVec( -1000000, 1000000, 10000 );
+    std::deque<int> d( values.begin(), values.end() );
+    radixSort( d.begin() + 10, d.end() - 10 );
+    CHECK( std::is_sorted( d.begin() + 10, d.end() - 10 ) );
+    CHECK( std::equal( d.begin(), d.begin() + 10, values.begin() ) );
+
+    // Extremes, and the short input path
+    std::vector<int64_t> wide = { 5, std::numeric_limits<int64_t>::max(), -1, std::numeric_limits<int64_t>::min(), 0 };
+    for ( int v : values ) wide.push_back( int64_t(v) * 1000003 );
+    for ( size_t n : { size_t(5), wide.size() } )
+    {
+        std::vector<int64_t> input( wide.begin(), wide.begin() + n );
+        auto expected = input;
+        std::sort( expected.begin(), expected.end() );
+        radixSort( input );
+        CHECK( input == expected );
+    }
+
+    std::vector<uint32_t> unsignedValues;
+    for ( int v : values ) unsignedValues.push_back( uint32_t(v) * 2654435761U );
+    auto expectedUnsigned = unsignedValues;
+    std::sort( expectedUnsigned.begin(), expectedUnsigned.end() );
+    radixSort( unsignedValues );
+    CHECK( unsignedValues == expectedUnsigned );
+
+    std::vector<double> doubles = { -0.5, std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(), 0.0, 1e-300, -1e300 };
+    for ( int v : values ) doubles.push_back( v / 7.0 );
+    auto expectedDoubles = doubles;
+    std::sort( expectedDoubles.begin(), expectedDoubles.end() );
+    radixSort( doubles );
+    CHECK( doubles == expectedDoubles );
+
+    std::vector<float> floats;
+    for ( int v : values ) floats.push_back( v / 3.0f );
+    radixSort( floats );
+    CHECK( std::is_sorted( floats.begin(), floats.end() ) );
+
+    // Records by an integer field, with equal keys left in their original
+    // order. The keys all fit in the low byte, so only one pass runs.
+    auto keys = randVec( 0, 200, 3000 );
+    std::vector<Keyed> records;
+    for ( size_t i = 0; i < keys.size(); ++i ) records.push_back( Keyed { keys[i], i } );
+    radixSort( records, []( const Keyed& r ) { return r.key; } );
+    for ( size_t i = 1; i < records.size(); ++i )
+    {
+        CHECK( records[i - 1].key <= records[i].key );
+        if ( records[i - 1].key == records[i].key ) CHECK( records[i - 1].order < records[i].order );
+    }
+}
+
+void selectionTest()
+{
+    auto scores = randVec( 0, 1000000, 100000 );
+    auto sorted = scores;
+    std::sort( sorted.begin(), sorted.end(), std::greater<int>() );
+
+    for ( size_t k : { 0, 1, 100, 1000 } )
+    {
+        auto best = topK( scores, k, std::greater<int>() );
+        CHECK_EQUAL( best.size(), k );
+        CHECK( std::equal( best.begin(), best.end(), sorted.begin() ) );
+    }
+
+    // More asked for than there are
+    std::vector<int> three = { 3, 1, 2 };
+    CHECK( topK( three, 5 ) == std::vector<int>( { 1, 2, 3 } ) );
+
+    // Input where every element beats all those before it
+    std::vector<int> ascending( 5000 );
+    for ( size_t i = 0; i < ascending.size(); ++i ) ascending[i] = int(i);
+    auto last = topK( ascending, 3, std::greater<int>() );
+    CHECK( last == std::vector<int>( { 4999, 4998, 4997 } ) );
+
+    // A single pass input range
+    std::istringstream stream( "5 3 9 1 7 9" );
+    auto fromStream = topK( std::istream_iterator<int>( stream ), std::istream_iterator<int>(), 3, std::greater<int>() );
+    CHECK( fromStream == std::vector<int>( { 9, 9, 7 } ) );
+
+    // Positions at both ends and the middle
+    std::sort( sorted.begin(), sorted.end() );
+    for ( size_t pos : { size_t(0), size_t(1), size_t(50000), size_t(99998), size_t(99999) } )
+    {
+        auto input = scores;
+        nthElement( input.begin(), input.begin() + pos, input.end() );
+        CHECK_EQUAL( input[pos], sorted[pos] );
+        CHECK( std::all_of( input.begin(), input.begin() + pos, [&]( int x ) { return x <= sorted[pos]; } ) );
+        CHECK( std::all_of( input.begin() + pos, input.end(), [&]( int x ) { return x >= sorted[pos]; } ) );
+
+        input = scores;
+        partialSort( input.begin(), input.begin() + pos, input.end() );
+        CHECK( std::equal( input.begin(), input.begin() + pos, sorted.begin() ) );
+    }
+
+    for ( size_t n : { 1, 2, 17, 33, 1000 } )
+    {
+        auto few = randVec( 0, 3, n );
+        auto fewSorted = few;
+        std::sort( fewSorted.begin(), fewSorted.end() );
+        for ( size_t pos = 0; pos < n; pos += std::max<size_t>( 1, n / 7 ) )
+        {
+            auto input = few;
+            nthElement( input.begin(), input.begin() + pos, input.end() );
+            CHECK_EQUAL( input[pos], fewSorted[pos] );
+        }
+    }
+
+    std::vector<std::string> words;
+    for ( int v : scores ) words.push_back( std::to_string( v ) );
+    auto wordsSorted = words;
+    std::sort( wordsSorted.begin(), wordsSorted.end() );
+    partialSort( words.begin(), words.begin() + 100, words.end() );
+    CHECK( std::equal( words.begin(), words.begin() + 100, wordsSorted.begin() ) );
+}
+
+// Every block size the networks handle, with each instruction set this CPU
+// supports, then sorts long enough to use them as a base case, with
+// duplicates and the values the padding uses
+template<typename T>
+void sortingNetworkTest( T scale )
+{
+    std::vector<T> values;
+    for ( int v : randVec( -50, 50, 2000 ) ) values.push_back( T(v) * scale );
+    values[3] = std::numeric_limits<T>::max();
+    values[40] = std::numeric_limits<T>::lowest();
+
+    for ( int isa = int( SortingNetworkIsa::scalar ); isa <= int( sortingNetworkIsa() ); ++isa )
+    {
+        for ( size_t n = 0; n <= sortingNetworkMaxSize; ++n )
+        {
+            std::vector<T> input( values.begin() + n, values.begin() + 2 * n );
+            auto expected = input;
+            std::sort( expected.begin(), expected.end() );
+            sortingNetworkSort( input.data(), n, SortingNetworkIsa( isa ) );
+            CHECK( input == expected );
+        }
+    }
+
+    auto expected = values;
+    std::sort( expected.begin(), expected.end() );
+
+    auto quick = values;
+    quickSort( quick );
+    CHECK( quick == expected );
+
+    auto merged = values;
+    mergeSort( merged.data(), merged.data() + merged.size() - 7, std::less<T>() );
+    CHECK( std::is_sorted( merged.begin(), merged.end() - 7 ) );
+    CHECK( std::equal( merged.end() - 7, merged.end(), values.end() - 7 ) );
+    mergeSort( merged );
+    CHECK( merged == expected );
+}
+
+void sortingNetworkTest()
+{
+    sortingNetworkTest<int32_t>( 1 );
+    sortingNetworkTest<int64_t>( int64_t(1) << 40 );
+    sortingNetworkTest<float>( 0.25f );
+    sortingNetworkTest<double>( 1e-3 );
+
+    // Zeros of both signs are equal, so a stable sort must keep their order
+    std::vector<double> zeros;
+    for ( size_t i = 0; i < 64; ++i ) zeros.push_back( i % 2 ? 0.0 : -0.0 );
+    auto expected = zeros;
+    std::stable_sort( expected.begin(), expected.end() );
+    mergeSort( zeros );
+    for ( size_t i = 0; i < zeros.size(); ++i ) CHECK_EQUAL( std::signbit( zeros[i] ), std::signbit( expected[i] ) );
+}
+
+// Bigger than externalSortMinReadBytes, so a merge can't read that many
+// bytes of every run at once
+struct BigRecord
+{
+    int     key;
+    char    payload[100000];
+
+    bool operator<( const BigRecord& other ) const { return key < other.key; }
+};
+
+void externalSortTest()
+{
+    const char* inPath = "externalsort_in.bin";
+    const char* outPath = "externalsort_out.bin";
+
+    auto values = randVec( -1000000, 1000000, 100000 );
+    {
+        std::ofstream out( inPath, std::ios::binary | std::ios::trunc );
+        out.write( reinterpret_cast<const char*>( values.data() ), values.size() * sizeof(int) );
+    }
+    auto expected = values;
+    std::sort( expected.begin(), expected.end(), std::greater<int>() );
+
+    auto readBack = [&]()
+    {
+        std::ifstream in( outPath, std::ios::binary );
+        std::vector<int> result( values.size() + 1 );
+        in.read( reinterpret_cast<char*>( result.data() ), result.size() * sizeof(int) );
+        result.resize( static_cast<size_t>( in.gcount() ) / sizeof(int) );
+        return result;
+    };
+
+    // A 64KB budget can only merge two runs at a time, so this takes several
+    // passes; 1MB takes one run and no merge at all.
+    auto stats = externalSort<int>( inPath, outPath, 64 * 1024, std::greater<int>() );
+    CHECK_EQUAL( stats.records, values.size() );
+    CHECK( stats.runs > 4 );
+    CHECK( stats.mergePasses > 1 );
+    CHECK( readBack() == expected );
+
+    stats = externalSort<int>( inPath, outPath, 1024 * 1024, std::greater<int>() );
+    CHECK_EQUAL( stats.runs, 1U );
+    CHECK_EQUAL( stats.mergePasses, 0U );
+    CHECK( readBack() == expected );
+
+    // A wide merge in a single pass
+    stats = externalSort<int>( inPath, outPath, 300 * 1024 );
+    CHECK( stats.runs > 1 );
+    CHECK_EQUAL( stats.mergePasses, 1U );
+    std::sort( expected.begin(), expected.end() );
+    CHECK( readBack() == expected );
+
+    // Ten runs of eight records, and room to read only eight of them at a
+    // time, a record each
+    {
+        std::vector<BigRecord> big( 80 );
+        auto keys = randVec( 0, 1000, big.size() );
+        for ( size_t i = 0; i < big.size(); ++i ) big[i].key = keys[i];
+        {
+            std::ofstream out( inPath, std::ios::binary | std::ios::trunc );
+            out.write( reinterpret_cast<const char*>( big.data() ), big.size() * sizeof(BigRecord) );
+        }
+        stats = externalSort<BigRecord>( inPath, outPath, 10 * sizeof(BigRecord) );
+        CHECK_EQUAL( stats.runs, 10U );
+        CHECK_EQUAL( stats.mergePasses, 2U );
+
+        std::vector<BigRecord> result( big.size() + 1 );
+        std::ifstream in( outPath, std::ios::binary );
+        in.read( reinterpret_cast<char*>( result.data() ), result.size() * sizeof(BigRecord) );
+        CHECK_EQUAL( static_cast<size_t>( in.gcount() ), big.size() * sizeof(BigRecord) );
+        result.resize( big.size() );
+        std::sort( keys.begin(), keys.end() );
+        for ( size_t i = 0; i < big.size(); ++i ) CHECK_EQUAL( result[i].key, keys[i] );
+    }
+
+    // Nothing but the output is left behind
+    CHECK( !std::ifstream( std::string( outPath ) + ".run0" ).good() );
+
+    // An empty input gives an empty output
+    std::ofstream( inPath, std::ios::binary | std::ios::trunc );
+    stats = externalSort<int>( inPath, outPath, 64 * 1024 );
+    CHECK_EQUAL( stats.records, 0U );
+    CHECK( readBack().empty() );
+
+    std::remove( inPath );
+    std::remove( outPath );
+}
+
+template<size_t Arity>
+void heapArityTest()
+{
+    auto input = randVec( -1000, 1000, 3000 );
+    heap<int, std::less<int>, Arity> h;
+    h.reserve( input.size() );
+    for ( int el : input ) h.push( el );
+
+    // Replacing the least with something larger makes it sink
+    auto sorted = input;
+    std::sort( sorted.begin(), sorted.end() );
+    h.replaceTop( 5000 );
+    sorted.erase( sorted.begin() );
+    sorted.push_back( 5000 );
+
+    for ( int el : sorted )
+    {
+        CHECK( !h.empty() );
+        CHECK_EQUAL( h.top(), el );
+        CHECK_EQUAL( h.pop(), el );
+    }
+    CHECK( h.empty() );
+
+    // There is no top to replace
+    bool threw = false;
+    try { h.replaceTop( 1 ); } catch ( std::runtime_error& ) { threw = true; }
+    CHECK( threw );
+    CHECK( h.empty() );
+}
+
 void heapTest()
 {  
     std::vector<int> input = { 4, 1, 2, 3, 6, 1, 5, 3, 7, 6, 0, 0, 0, 0, 100, 100, 100, 100, 100 };
@@ -228,6 +1417,133 @@ void heapTest()
         CHECK_EQUAL( h.pop(), el );
     }
     CHECK( h.empty() );
+
+    heapArityTest<2>();
+    heapArityTest<3>();
+    heapArityTest<4>();
+    heapArityTest<8>();
+
+    // Elements that can only be moved, ordered through a comparison
+    auto byValue = []( const std::unique_ptr<int>& a, const std::unique_ptr<int>& b ) { return *a > *b; };
+    heap<std::unique_ptr<int>, decltype( byValue )> largest( byValue );
+    for ( int el : input ) largest.push( std::unique_ptr<int>( new int( el ) ) );
+    for ( auto it = result.rbegin(); it != result.rend(); ++it ) CHECK_EQUAL( *largest.pop(), *it );
+}
+
+void addressableHeapTest()
+{
+    // Random pushes, pops, updates and erases, against a map from each live
+    // handle to the value it should hold
+    AddressableHeap<int> h;
+    std::map<size_t, int> live;
+    std::mt19937 gen( 0xdeadbeef );
+    std::uniform_int_distribution<int> value( -1000, 1000 );
+    for ( size_t step = 0; step < 5000; ++step )
+    {
+        int op = value( gen ) & 7;
+        if ( live.empty() || op < 3 )
+        {
+            int v = value( gen );
+            size_t handle = h.push( v );
+            CHECK( live.count( handle ) == 0 );
+            live[handle] = v;
+            continue;
+        }
+
+        auto it = live.begin();
+        std::advance( it, size_t( value( gen ) + 1000 ) % live.size() );
+        CHECK_EQUAL( h.get( it->first ), it->second );
+        if ( op == 3 )
+        {
+            int least = std::min_element( live.begin(), live.end(), []( const std::pair<const size_t, int>& a, const std::pair<const size_t, int>& b ) { return a.second < b.second; } )->second;
+            CHECK_EQUAL( h.top(), least );
+            CHECK_EQUAL( live[h.topHandle()], least );
+            live.erase( h.topHandle() );
+            CHECK_EQUAL( h.pop(), least );
+        }
+        else if ( op == 4 )
+        {
+            it->second -= value( gen ) & 63;
+            h.decreaseKey( it->first, it->second );
+        }
+        else if ( op == 5 )
+        {
+            it->second += value( gen ) & 63;
+            h.increaseKey( it->first, it->second );
+        }
+        else if ( op == 6 )
+        {
+            it->second = value( gen );
+            h.update( it->first, it->second );
+        }
+        else
+        {
+            h.erase( it->first );
+            CHECK( !h.contains( it->first ) );
+            live.erase( it );
+        }
+        CHECK_EQUAL( h.size(), live.size() );
+    }
+
+    // Dijkstra on a random graph, updating each vertex's queue entry in
+    // place, against a queue of duplicates where stale entries are skipped
+    const size_t vertices = 2000;
+    std::vector<std::vector<std::pair<size_t, int>>> edges( vertices );
+    std::uniform_int_distribution<size_t> vertex( 0, vertices - 1 );
+    for ( size_t e = 0; e < vertices * 8; ++e ) edges[vertex( gen )].push_back( std::make_pair( vertex( gen ), (value( gen ) & 255) + 1 ) );
+
+    const int unreached = std::numeric_limits<int>::max();
+    std::vector<int> expected( vertices, unreached );
+    {
+        typedef std::pair<int, size_t> Item;
+        heap<Item> queue;
+        expected[0] = 0;
+        queue.push( Item( 0, 0 ) );
+        while ( !queue.empty() )
+        {
+            Item item = queue.pop();
+            if ( item.first > expected[item.second] ) continue;
+            for ( const auto& edge : edges[item.second] )
+            {
+                int d = item.first + edge.second;
+                if ( d < expected[edge.first] )
+                {
+                    expected[edge.first] = d;
+                    queue.push( Item( d, edge.first ) );
+                }
+            }
+        }
+    }
+
+    std::vector<int> distance( vertices, unreached );
+    std::vector<size_t> handles( vertices );
+    std::vector<bool> queued( vertices, false );
+    auto byDistance = [&]( size_t a, size_t b ) { return distance[a] < distance[b]; };
+    AddressableHeap<size_t, decltype( byDistance )> queue( byDistance );
+    distance[0] = 0;
+    handles[0] = queue.push( 0 );
+    queued[0] = true;
+    size_t largest = 0;
+    while ( !queue.empty() )
+    {
+        size_t v = queue.pop();
+        queued[v] = false;
+        for ( const auto& edge : edges[v] )
+        {
+            int d = distance[v] + edge.second;
+            if ( d >= distance[edge.first] ) continue;
+
+            // The order is read through distance, so the entry's value stays
+            // the same and only its place in the heap changes
+            distance[edge.first] = d;
+            if ( queued[edge.first] ) queue.decreaseKey( handles[edge.first], edge.first );
+            else handles[edge.first] = queue.push( edge.first );
+            queued[edge.first] = true;
+            largest = std::max( largest, queue.size() );
+        }
+    }
+    CHECK( distance == expected );
+    CHECK( largest <= vertices );
 }
 
 void balancedBSTTest()
@@ -290,10 +1606,32 @@ int main( int /*argc*/, char** /*argv*/ )
 {
     std::cerr << "Running data structure tests" << std::endl;
     mergeSortTest();
+    threadPoolTest();
+    parallelMergeSortTest();
+    sortApiTest();
     quickSortTest();
+    quickSortAdversarialTest();
+    sampleSortTest();
+    adaptiveMergeSortTest();
+    radixSortTest();
+    selectionTest();
+    sortingNetworkTest();
+    externalSortTest();
     hashTest();
     openAddressingHashTest();
+    openAddressingChurnTest();
+    inlineRowsTest();
+    hashGrowthTest();
+    incrementalRehashTest();
+    robinHoodTest();
+    hashInPlaceApiTest();
+    batchLookupTest();
+    reductionPolicyTest();
+    snapshotTest();
+    statsTest();
+    filterTest();
     heapTest();
+    addressableHeapTest();
     balancedBSTTest();
     std::cerr << "Complete" << std::endl;
 }
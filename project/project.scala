@@ -7,7 +7,9 @@ object TestBuild extends NativeDefaultBuild
         
     val utility = StaticLibrary( "utility", file( "libraries/utility" ), Seq() )
    
-    val datastructures = StaticLibrary( "datastructures", file( "libraries/datastructures" ), Seq() )
+    val datastructures = StaticLibrary( "datastructures", file( "libraries/datastructures" ), Seq(
+            nativeLibraries += "pthread"
+        ) )
         .nativeDependsOn( utility )
     
     val functionalcollections = StaticLibrary( "functionalcollections", file( "libraries/functionalcollections" ), Seq() )
@@ -16,10 +18,16 @@ object TestBuild extends NativeDefaultBuild
     val concurrency = StaticLibrary( "concurrency", file( "libraries/concurrency" ), Seq(
             nativeLibraries += "pthread"
         ) )
-        .nativeDependsOn( utility )
+        .nativeDependsOn( utility, datastructures )
    
     val simple = NativeExecutable( "simple", file( "applications/simple" ), Seq() )
         .nativeDependsOn( utility )
+        
+    val hashbench = NativeExecutable( "hashbench", file( "applications/hashbench" ), Seq() )
+        .nativeDependsOn( utility, datastructures )
+        
+    val sortbench = NativeExecutable( "sortbench", file( "applications/sortbench" ), Seq() )
+        .nativeDependsOn( utility, datastructures )
 }
 
 